@@ -34,6 +34,29 @@ bool Actor::Update()
 	return true;
 }
 
+ThingKind Actor::Kind() const
+{
+	return KIND_PERSISTENT;
+}
+
+void Actor::Remember()
+{
+	prev_ = pos_;
+	remembered_ = true;
+}
+
+Float3 Actor::Interpolate(float alpha) const
+{
+	// The sprites can be drawn away from the real position, like the puffs that rise
+	Float3 pos = {PosX(), PosY(), PosZ()};
+
+	if (!remembered_)
+		return pos;
+
+	float back = 1.0f - alpha;
+	return {pos.x - (pos_.x - prev_.x) * back, pos.y - (pos_.y - prev_.y) * back, pos.z - (pos_.z - prev_.z) * back};
+}
+
 Weapon::Weapon(float x, float y, float z, const string& type)
 {
 	pos_.x = x;
@@ -43,14 +66,14 @@ Weapon::Weapon(float x, float y, float z, const string& type)
 	Type_ = type;
 	Filename_ = Type_ + ".png";
 
-	Cache::Instance()->Add(Filename_, false);
+	Cache::Instance()->Acquire(Filename_, false);
 	Radius_ = Cache::Instance()->Get(Filename_)->Width() / 64.0f;
 	Height_ = Cache::Instance()->Get(Filename_)->Height() * 2.0f / 64.0f;
 }
 
 Weapon::~Weapon()
 {
-	// Empty
+	Cache::Instance()->Release(Filename_);
 }
 
 float Weapon::PosX() const
@@ -91,7 +114,7 @@ Puff::Puff(float x, float y, float z)
 
 	for (unsigned int i = 0; i < sprites_.size(); i++)
 	{
-		Cache::Instance()->Add(sprites_[i], false);
+		Cache::Instance()->Acquire(sprites_[i], false);
 	}
 
 	Age_ = 0;
@@ -99,7 +122,10 @@ Puff::Puff(float x, float y, float z)
 
 Puff::~Puff()
 {
-	// Empty
+	for (unsigned int i = 0; i < sprites_.size(); i++)
+	{
+		Cache::Instance()->Release(sprites_[i]);
+	}
 }
 
 float Puff::PosX() const
@@ -147,6 +173,11 @@ Texture* Puff::GetSprite(Float3 /*CamPos*/) const
 	return Cache::Instance()->Get(sprites_[3]);
 }
 
+ThingKind Puff::Kind() const
+{
+	return KIND_PUFF;
+}
+
 bool Puff::Update()
 {
 	Age_++;
@@ -167,7 +198,7 @@ Blood::Blood(float x, float y, float z, float groundz)
 
 	for (unsigned int i = 0; i < sprites_.size(); i++)
 	{
-		Cache::Instance()->Add(sprites_[i], false);
+		Cache::Instance()->Acquire(sprites_[i], false);
 	}
 
 	Age_ = 0;
@@ -176,7 +207,10 @@ Blood::Blood(float x, float y, float z, float groundz)
 
 Blood::~Blood()
 {
-	// Empty
+	for (unsigned int i = 0; i < sprites_.size(); i++)
+	{
+		Cache::Instance()->Release(sprites_[i]);
+	}
 }
 
 float Blood::PosX() const
@@ -221,6 +255,11 @@ Texture* Blood::GetSprite(Float3 /*CamPos*/) const
 	return Cache::Instance()->Get(sprites_[2]);
 }
 
+ThingKind Blood::Kind() const
+{
+	return KIND_BLOOD;
+}
+
 bool Blood::Update()
 {
 	MomZ_ += GRAVITY * 0.05f;
@@ -244,14 +283,14 @@ Plasma::Plasma(float x, float y, float z, float velx, float vely, float velz)
 	mom_.y = vely;
 	mom_.z = velz;
 
-	Cache::Instance()->Add(sprite_, false);
+	Cache::Instance()->Acquire(sprite_, false);
 
 	Age_ = 0;
 }
 
 Plasma::~Plasma()
 {
-	// Empty
+	Cache::Instance()->Release(sprite_);
 }
 
 float Plasma::PosX() const
@@ -284,6 +323,11 @@ Texture* Plasma::GetSprite(Float3 /*CamPos*/) const
 	return Cache::Instance()->Get(sprite_);
 }
 
+ThingKind Plasma::Kind() const
+{
+	return KIND_PLASMA;
+}
+
 bool Plasma::Update()
 {
 	Age_++;
@@ -33,6 +33,15 @@ const float GRAVITY = 0.2f;
 //const float PI = atan(1) * 4;
 const int MAXOWNEDWEAPONS = 10;
 
+// Tells which class a thing is when it's read back from a world snapshot
+enum ThingKind : unsigned char
+{
+	KIND_PERSISTENT = 0,	// Lasts as long as the level, not part of the snapshots
+	KIND_PUFF,
+	KIND_BLOOD,
+	KIND_PLASMA
+};
+
 class Actor
 {
 public:
@@ -56,6 +65,11 @@ public:
 	virtual Texture* GetSprite(Float3 CamPos) const = 0;
 
 	virtual bool Update();	// Returns 'true' if still alive, 'false' if it needs to be deleted.
+	virtual ThingKind Kind() const;
+
+	// The things are drawn between their state before the last tic and their current state
+	virtual void Remember();	// Called before each tic
+	Float3 Interpolate(float alpha) const;	// Position between the last two tics. 'alpha' goes from 0 to 1.
 
 	// So the compiler doesn't warn on deleting an object of polymorphic class type
 	// https://stackoverflow.com/questions/353817/should-every-class-have-a-virtual-destructor
@@ -64,16 +78,18 @@ public:
 //protected:
 //	Texture* sprite;
 	Float3 pos_;	// Position
-	Float3 mom_;	// Momentum
+	Float3 mom_ = {0, 0, 0};	// Momentum
+	Float3 prev_ = {0, 0, 0};	// Position before the last tic
+	bool remembered_ = false;	// A thing that spawned during the last tic has no previous position
 	//float Radius;
-	Plane* plane;
+	Plane* plane = nullptr;
 };
 
 class Weapon: public Actor
 {
 public:
 	Weapon(float x, float y, float z, const string& type);
-	~Weapon();	// Deletes the sprite
+	~Weapon();	// Releases the sprite
 
 	float PosX() const;
 	float PosY() const;
@@ -109,6 +125,7 @@ public:
 	const vector<string> sprites_ = {"puffa0.png", "puffb0.png", "puffc0.png", "puffd0.png"};
 	Texture* GetSprite(Float3 CamPos) const;
 	bool Update();
+	ThingKind Kind() const;
 };
 
 class Blood: public Actor
@@ -132,6 +149,7 @@ public:
 	const vector<string> sprites_ = {"bluda0.png", "bludb0.png", "bludc0.png"};
 	Texture* GetSprite(Float3 CamPos) const;
 	bool Update();
+	ThingKind Kind() const;
 };
 
 class Plasma: public Actor
@@ -156,6 +174,7 @@ public:
 	const string sprite_ = "aplsa0.png";
 	Texture* GetSprite(Float3 CamPos) const;
 	bool Update();
+	ThingKind Kind() const;
 };
 
 
@@ -0,0 +1,464 @@
+// Copyright (C) 2020 Alexandre-Xavier Labonté-Lamoureux
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// archive.cpp
+// Single-file asset archive with a sorted directory. Resources are opened by
+// name as memory-mapped slices. Loose files override the archive's entries.
+
+#include "archive.h"
+
+#include <sys/mman.h>	/* mmap, munmap */
+#include <sys/stat.h>	/* stat, fstat */
+#include <fcntl.h>		/* open */
+#include <unistd.h>		/* close, sysconf */
+
+#include <algorithm>	/* sort, unique, min */
+#include <cstdint>		/* uintptr_t */
+#include <cstring>		/* memcmp, strncmp */
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+using namespace std;
+
+// Read a little-endian 32-bit integer
+static unsigned int ReadLong(const unsigned char* p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+
+// Write a little-endian 32-bit integer
+static void WriteLong(ostream& out, unsigned int value)
+{
+	const char bytes[4] = {(char)value, (char)(value >> 8), (char)(value >> 16), (char)(value >> 24)};
+	out.write(bytes, sizeof(bytes));
+}
+
+/****************************** Lump ******************************/
+
+Lump::Lump(Lump&& other)
+{
+	*this = move(other);
+}
+
+Lump& Lump::operator=(Lump&& other)
+{
+	if (this != &other)
+	{
+		Unmap();
+
+		data_ = other.data_;
+		size_ = other.size_;
+		open_ = other.open_;
+		map_ = other.map_;
+		mapSize_ = other.mapSize_;
+
+		other.data_ = nullptr;
+		other.size_ = 0;
+		other.open_ = false;
+		other.map_ = nullptr;
+		other.mapSize_ = 0;
+	}
+
+	return *this;
+}
+
+Lump::~Lump()
+{
+	Unmap();
+}
+
+void Lump::Unmap()
+{
+	if (map_)
+	{
+		munmap(map_, mapSize_);
+		map_ = nullptr;
+		mapSize_ = 0;
+	}
+}
+
+bool Lump::MapFile(const string& path)
+{
+	Unmap();
+	open_ = false;
+
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat info;
+	if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode))
+	{
+		close(fd);
+		return false;
+	}
+
+	// An empty file can't be mapped, but it's still a valid resource
+	if (info.st_size > 0)
+	{
+		void* map = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (map == MAP_FAILED)
+		{
+			close(fd);
+			return false;
+		}
+
+		map_ = map;
+		mapSize_ = info.st_size;
+	}
+
+	// The mapping stays valid after the descriptor is closed
+	close(fd);
+
+	data_ = static_cast<const unsigned char*>(map_);
+	size_ = mapSize_;
+	open_ = true;
+
+	return true;
+}
+
+void Lump::SetSlice(const unsigned char* data, size_t size)
+{
+	Unmap();
+	data_ = data;
+	size_ = size;
+	open_ = true;
+}
+
+bool Lump::IsOpen() const
+{
+	return open_;
+}
+
+const unsigned char* Lump::Data() const
+{
+	return data_;
+}
+
+size_t Lump::Size() const
+{
+	return size_;
+}
+
+// The whole pages that contain a part of the lump
+static void Advise(const unsigned char* data, size_t size, int advice)
+{
+	if (size == 0)
+		return;
+
+	uintptr_t page = sysconf(_SC_PAGESIZE);
+	uintptr_t begin = reinterpret_cast<uintptr_t>(data) & ~(page - 1);
+	uintptr_t end = reinterpret_cast<uintptr_t>(data) + size;
+	madvise(reinterpret_cast<void*>(begin), end - begin, advice);
+}
+
+void Lump::Sequential() const
+{
+	Advise(data_, size_, MADV_SEQUENTIAL);
+}
+
+void Lump::Prefetch(size_t offset, size_t size) const
+{
+	if (offset < size_)
+		Advise(data_ + offset, min(size, size_ - offset), MADV_WILLNEED);
+}
+
+/****************************** Archive ******************************/
+
+Archive::Archive(const string& path)
+{
+	path_ = path;
+
+	if (!file_.MapFile(path))
+	{
+		throw runtime_error("Could not open archive '" + path + "'");
+	}
+
+	const unsigned char* base = file_.Data();
+
+	if (file_.Size() < ARCHIVE_HEADER_SIZE || memcmp(base, ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC)) != 0)
+	{
+		throw runtime_error("File '" + path + "' is not an archive");
+	}
+
+	if (ReadLong(base + 4) != ARCHIVE_VERSION)
+	{
+		throw runtime_error("Archive '" + path + "' has an unsupported version (" + to_string(ReadLong(base + 4)) + ")");
+	}
+
+	count_ = ReadLong(base + 8);
+	size_t offset = ReadLong(base + 12);
+
+	if (offset > file_.Size() || (file_.Size() - offset) / ARCHIVE_ENTRY_SIZE < count_)
+	{
+		throw runtime_error("Archive '" + path + "' has a truncated directory");
+	}
+
+	directory_ = base + offset;
+
+	// Make sure that every entry points inside the file so lookups don't have to check it
+	for (unsigned int i = 0; i < count_; i++)
+	{
+		const unsigned char* entry = directory_ + i * ARCHIVE_ENTRY_SIZE;
+		size_t start = ReadLong(entry + ARCHIVE_NAME_SIZE);
+		size_t size = ReadLong(entry + ARCHIVE_NAME_SIZE + 4);
+
+		if (start > file_.Size() || size > file_.Size() - start)
+		{
+			throw runtime_error("Archive '" + path + "' has an entry that is out of bounds");
+		}
+	}
+}
+
+string Archive::Path() const
+{
+	return path_;
+}
+
+unsigned int Archive::Count() const
+{
+	return count_;
+}
+
+bool Archive::Find(const string& name, const unsigned char*& data, size_t& size) const
+{
+	if (name.size() >= ARCHIVE_NAME_SIZE)
+		return false;
+
+	// The directory is sorted, so a binary search is possible
+	unsigned int low = 0;
+	unsigned int high = count_;
+
+	while (low < high)
+	{
+		unsigned int middle = low + (high - low) / 2;
+		const unsigned char* entry = directory_ + middle * ARCHIVE_ENTRY_SIZE;
+		int result = strncmp(name.c_str(), reinterpret_cast<const char*>(entry), ARCHIVE_NAME_SIZE);
+
+		if (result == 0)
+		{
+			data = file_.Data() + ReadLong(entry + ARCHIVE_NAME_SIZE);
+			size = ReadLong(entry + ARCHIVE_NAME_SIZE + 4);
+			return true;
+		}
+		else if (result < 0)
+		{
+			high = middle;
+		}
+		else
+		{
+			low = middle + 1;
+		}
+	}
+
+	return false;
+}
+
+/****************************** Resources ******************************/
+
+Resources* Resources::instance_ = nullptr;
+
+Resources::Resources()
+{
+	// Empty
+}
+
+Resources::~Resources()
+{
+	for (unsigned int i = 0; i < archives_.size(); i++)
+	{
+		delete archives_[i];
+	}
+}
+
+bool Resources::Mount(const string& path)
+{
+	struct stat info;
+	if (stat(path.c_str(), &info) != 0)
+		return false;
+
+	archives_.push_back(new Archive(path));
+	cout << "Mounted archive '" << path << "' (" << archives_.back()->Count() << " entries)" << endl;
+
+	return true;
+}
+
+Lump Resources::Open(const string& name) const
+{
+	Lump lump;
+
+	// Loose files have priority so that resources can be tested without rebuilding the archive
+	if (lump.MapFile(name))
+		return lump;
+
+	for (int i = archives_.size() - 1; i >= 0; i--)
+	{
+		const unsigned char* data;
+		size_t size;
+
+		if (archives_[i]->Find(name, data, size))
+		{
+			lump.SetSlice(data, size);
+			break;
+		}
+	}
+
+	return lump;
+}
+
+bool Resources::Exists(const string& name) const
+{
+	struct stat info;
+	if (stat(name.c_str(), &info) == 0 && S_ISREG(info.st_mode))
+		return true;
+
+	for (unsigned int i = 0; i < archives_.size(); i++)
+	{
+		const unsigned char* data;
+		size_t size;
+
+		if (archives_[i]->Find(name, data, size))
+			return true;
+	}
+
+	return false;
+}
+
+Resources* Resources::Instance()
+{
+	if (!instance_)
+		instance_ = new Resources;
+	return instance_;
+}
+
+void Resources::DestroyInstance()
+{
+	delete instance_;	// Archives will be unmapped
+	instance_ = nullptr;
+}
+
+/****************************** LumpStream ******************************/
+
+void LumpStream::Buffer::Set(const unsigned char* data, size_t size)
+{
+	// The stream never writes to the buffer, so it's safe to remove the const
+	char* begin = const_cast<char*>(reinterpret_cast<const char*>(data));
+	setg(begin, begin, begin + size);
+}
+
+LumpStream::LumpStream(): istream(&buffer_)
+{
+	// Empty
+}
+
+LumpStream::LumpStream(const string& name): istream(&buffer_)
+{
+	open(name);
+}
+
+void LumpStream::open(const string& name)
+{
+	lump_ = Resources::Instance()->Open(name);
+	buffer_.Set(lump_.Data(), lump_.Size());
+
+	if (lump_.IsOpen())
+		clear();
+	else
+		setstate(ios::failbit);
+}
+
+bool LumpStream::is_open() const
+{
+	return lump_.IsOpen();
+}
+
+void LumpStream::close()
+{
+	lump_ = Lump();
+	buffer_.Set(nullptr, 0);
+}
+
+const Lump& LumpStream::lump() const
+{
+	return lump_;
+}
+
+/****************************** Packer ******************************/
+
+void PackArchive(const string& path, vector<string> files)
+{
+	// The directory must be sorted for the binary search
+	sort(files.begin(), files.end());
+	files.erase(unique(files.begin(), files.end()), files.end());
+
+	ofstream out(path, ios::binary);
+	if (!out.is_open())
+	{
+		throw runtime_error("Could not open file '" + path + "' to write");
+	}
+
+	// Reserve space for the header. It's written last.
+	out.write(string(ARCHIVE_HEADER_SIZE, '\0').data(), ARCHIVE_HEADER_SIZE);
+
+	vector<unsigned int> offsets;
+	vector<unsigned int> sizes;
+
+	for (unsigned int i = 0; i < files.size(); i++)
+	{
+		if (files[i].size() >= ARCHIVE_NAME_SIZE)
+		{
+			throw runtime_error("Name '" + files[i] + "' is too long for the archive (max " + to_string(ARCHIVE_NAME_SIZE - 1) + " characters)");
+		}
+
+		Lump lump;
+		if (!lump.MapFile(files[i]))
+		{
+			throw runtime_error("Could not read file '" + files[i] + "'");
+		}
+
+		offsets.push_back(out.tellp());
+		sizes.push_back(lump.Size());
+		out.write(reinterpret_cast<const char*>(lump.Data()), lump.Size());
+
+		cout << "Packed '" << files[i] << "' (" << lump.Size() << " bytes)" << endl;
+	}
+
+	unsigned int directory = out.tellp();
+
+	for (unsigned int i = 0; i < files.size(); i++)
+	{
+		string name = files[i];
+		name.resize(ARCHIVE_NAME_SIZE, '\0');
+		out.write(name.data(), ARCHIVE_NAME_SIZE);
+		WriteLong(out, offsets[i]);
+		WriteLong(out, sizes[i]);
+	}
+
+	// Go back to the beginning and write the header
+	out.seekp(0);
+	out.write(ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC));
+	WriteLong(out, ARCHIVE_VERSION);
+	WriteLong(out, files.size());
+	WriteLong(out, directory);
+
+	if (!out)
+	{
+		throw runtime_error("Error while writing archive '" + path + "'");
+	}
+
+	cout << "Archive '" << path << "' contains " << files.size() << " entries." << endl;
+}
@@ -0,0 +1,141 @@
+// Copyright (C) 2020 Alexandre-Xavier Labonté-Lamoureux
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// archive.h
+// Single-file asset archive with a sorted directory. Resources are opened by
+// name as memory-mapped slices. Loose files override the archive's entries.
+
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include <cstddef>	/* size_t */
+#include <istream>
+#include <streambuf>
+#include <string>
+#include <vector>
+using namespace std;
+
+// Archive layout. Integers are 32 bits and little-endian.
+//   Header:    "MGPK", version, number of entries, offset of the directory
+//   Data:      the content of every entry, back to back
+//   Directory: one entry per file, sorted by name
+const char ARCHIVE_MAGIC[4] = {'M', 'G', 'P', 'K'};
+const unsigned int ARCHIVE_VERSION = 1;
+const unsigned int ARCHIVE_HEADER_SIZE = 16;
+const unsigned int ARCHIVE_NAME_SIZE = 56;	// Includes the terminating zero
+const unsigned int ARCHIVE_ENTRY_SIZE = ARCHIVE_NAME_SIZE + 8;
+
+// Read-only view of a resource. Loose files are mapped, archive entries point inside the archive's mapping.
+class Lump
+{
+private:
+	const unsigned char* data_ = nullptr;
+	size_t size_ = 0;
+	bool open_ = false;
+
+	void* map_ = nullptr;	// Owned mapping (loose files only)
+	size_t mapSize_ = 0;
+
+	void Unmap();
+
+public:
+	Lump() = default;
+	Lump(const Lump&) = delete;
+	Lump& operator=(const Lump&) = delete;
+	Lump(Lump&& other);
+	Lump& operator=(Lump&& other);
+	~Lump();
+
+	bool MapFile(const string& path);	// Map a loose file
+	void SetSlice(const unsigned char* data, size_t size);	// Point to memory owned by someone else
+
+	bool IsOpen() const;
+	const unsigned char* Data() const;
+	size_t Size() const;
+
+	// Hints for the system. The data is mapped, so it's only read from the disk when it's touched.
+	void Sequential() const;	// It will be read from the beginning to the end
+	void Prefetch(size_t offset, size_t size) const;	// It will be read soon, start loading it in the background
+};
+
+class Archive
+{
+private:
+	string path_;
+	Lump file_;
+	const unsigned char* directory_ = nullptr;
+	unsigned int count_ = 0;
+
+public:
+	explicit Archive(const string& path);	// Throws if the file is not a valid archive
+
+	string Path() const;
+	unsigned int Count() const;
+
+	// Binary search in the directory. Returns false if there's no such entry.
+	bool Find(const string& name, const unsigned char*& data, size_t& size) const;
+};
+
+// Opens resources by name. It uses the singleton pattern.
+class Resources
+{
+private:
+	vector<Archive*> archives_;
+
+	static Resources* instance_;
+
+	Resources();
+	~Resources();
+
+public:
+	// Archives mounted last have priority. Returns false if the file does not exist.
+	bool Mount(const string& path);
+
+	// Loose files are looked up first, then the archives
+	Lump Open(const string& name) const;
+	bool Exists(const string& name) const;
+
+	static Resources* Instance();
+	static void DestroyInstance();
+};
+
+// Input stream that reads a resource without copying it. Mimics the interface of 'ifstream'.
+class LumpStream: public istream
+{
+private:
+	class Buffer: public streambuf
+	{
+	public:
+		void Set(const unsigned char* data, size_t size);
+	};
+
+	Lump lump_;
+	Buffer buffer_;
+
+public:
+	LumpStream();
+	explicit LumpStream(const string& name);
+
+	void open(const string& name);
+	bool is_open() const;
+	void close();
+
+	const Lump& lump() const;
+};
+
+// Write an archive that contains the specified files. Used by the packer tool.
+void PackArchive(const string& path, vector<string> files);
+
+#endif	// ARCHIVE_H
@@ -0,0 +1,211 @@
+// Copyright (C) 2020 Alexandre-Xavier Labonté-Lamoureux
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// botclient.cpp
+// Clients without a window that join a game to measure how many players a server can handle.
+// Each client is a process because the random numbers and the texture cache are global.
+
+#include "botclient.h"
+#include "command.h"	/* FindArgumentPosition, FindArgumentParameter */
+#include "level.h"
+#include "player.h"
+#include "ticcmd.h"
+#include "network.h"
+#include "netgame.h"
+#include "random.h"		/* SetIndex */
+#include "strutils.h"	/* Split */
+#include "bot.h"
+#include "archive.h"	/* Resources */
+#include "demo.h"
+#include "cache.h"
+#include "pacer.h"
+
+#include <sys/types.h>
+#include <sys/wait.h>	/* waitpid */
+#include <unistd.h>		/* fork */
+
+#include <chrono>
+#include <cstdlib>		/* EXIT_FAILURE, EXIT_SUCCESS */
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+using namespace std;
+
+const int TICRATE = 60;
+
+int botclient(int argc, const char* argv[])
+{
+	string serverloc = FindArgumentParameter(argc, argv, "-connect", "localhost:5555");
+	unsigned int tics = stoul(FindArgumentParameter(argc, argv, "-tics", "0"));	// 0 plays until a player quits
+
+	// Only the size of the textures matters for the game
+	Cache::Instance()->SetHeadless();
+
+	string ArchiveName = FindArgumentParameter(argc, argv, "-archive", "meshglide.mgpk");
+	if (!Resources::Instance()->Mount(ArchiveName) && FindArgumentPosition(argc, argv, "-archive") > 0)
+	{
+		throw runtime_error("Could not open archive '" + ArchiveName + "'");
+	}
+
+	// The bot can replay the commands of a player from a demo instead of thinking
+	DemoReader DemoRead;
+	string DemoName = FindArgumentParameter(argc, argv, "-botdemo");
+	if (!DemoName.empty())
+		DemoRead.Open(DemoName);
+
+	/****************************** NETWORKING ******************************/
+
+	Network network;
+	vector<string> infos = Split(network.connectClient(serverloc), '\n');
+	string LevelName = infos[0];
+	SetIndex(stoi(infos[1]));
+	unsigned int numOfPlayers = stoul(infos[2]);
+	unsigned int me = network.myPlayer();
+
+	NetGame netgame(network, numOfPlayers, stoul(infos[3]), stoul(infos[4]));
+	bool Optimize = infos.size() > 5 && infos[5] == "1";	// Same level geometry as the server
+
+	if (FindArgumentPosition(argc, argv, "-netlog") > 0)
+		netgame.SetLog(FindArgumentParameter(argc, argv, "-netlog", "netgame.log") + '.' + to_string(me + 1));
+
+	/****************************** LEVEL LOADING ******************************/
+
+	Level* CurrentLevel = new Level(LevelName, stof(FindArgumentParameter(argc, argv, "-scale", "1.0")), numOfPlayers, Optimize);
+	CurrentLevel->play = CurrentLevel->players[me];
+
+	/****************************** GAME LOOP ******************************/
+
+	auto start = chrono::steady_clock::now();
+	Pacer TicPacer(TICRATE);	// Keeps the pace of a real client
+	unsigned int ConfirmedTic = 0;
+	bool Quit = false;
+
+	for (unsigned int TicCount = 0; !Quit; TicCount++)
+	{
+		Player* play = CurrentLevel->play;
+		Ticcmd cmd;
+		cmd.id = me;
+
+		if (DemoRead.IsOpen())
+		{
+			// Play the demo again when it ends. The other players of the demo are skipped.
+			if (!DemoRead.Read(me % DemoRead.Players(), cmd))
+			{
+				DemoRead.Open(DemoName);
+				DemoRead.Read(me % DemoRead.Players(), cmd);
+			}
+
+			cmd.id = me;
+		}
+		else
+		{
+			// The bot changes its own timer, but it must only change during the tics
+			int lastShot = play->TimeSinceLastShot;
+			play->Cmd = cmd;
+			updateBot(play, CurrentLevel);
+			cmd = play->Cmd;
+			play->TimeSinceLastShot = lastShot;
+		}
+
+		cmd.quit = tics > 0 && TicCount >= tics;
+		netgame.Submit(cmd);
+		netgame.Wait(TicCount);
+
+		if (netgame.Rollback())
+		{
+			netgame.Simulate(*CurrentLevel, TicCount);
+
+			for (; ConfirmedTic < netgame.Confirmed(); ConfirmedTic++)
+			{
+				for (unsigned int i = 0; i < numOfPlayers; i++)
+					Quit = Quit || netgame.Command(ConfirmedTic, i).quit;
+			}
+		}
+		else
+		{
+			netgame.Load(TicCount, CurrentLevel->players);
+			CurrentLevel->RunTic();
+			netgame.Record(TicCount, *CurrentLevel);
+
+			for (unsigned int i = 0; i < numOfPlayers; i++)
+				Quit = Quit || CurrentLevel->players[i]->Cmd.quit;
+		}
+
+		TicPacer.Wait();
+	}
+
+	/****************************** TERMINATION ******************************/
+
+	long elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count();
+	cout << "Bot " << me + 1 << ": " << TicPacer.Late() << " tics were late, played for " << elapsed << " ms." << endl;
+	netgame.PrintStats();
+
+	delete CurrentLevel;
+	Cache::DestroyInstance();
+	Resources::DestroyInstance();
+
+	return EXIT_SUCCESS;
+}
+
+int swarm(int argc, const char* argv[])
+{
+	unsigned int count = stoul(FindArgumentParameter(argc, argv, "-swarm", "1"));
+	vector<pid_t> children;
+
+	cout << "Starting " << count << " bot clients" << endl;
+
+	for (unsigned int i = 0; i < count; i++)
+	{
+		pid_t pid = fork();
+
+		if (pid < 0)
+		{
+			throw runtime_error("Could not start bot client " + to_string(i + 1));
+		}
+
+		if (pid == 0)
+		{
+			int status = EXIT_FAILURE;
+
+			try
+			{
+				status = botclient(argc, argv);
+			}
+			catch (const exception& e)
+			{
+				cerr << "Bot client error: " << e.what() << endl;
+			}
+
+			cout.flush();
+			_exit(status);
+		}
+
+		children.push_back(pid);
+	}
+
+	unsigned int failed = 0;
+
+	for (unsigned int i = 0; i < children.size(); i++)
+	{
+		int status;
+		if (waitpid(children[i], &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS)
+			failed++;
+	}
+
+	cout << count - failed << " of " << count << " bot clients ended normally." << endl;
+
+	return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,28 @@
+// Copyright (C) 2020 Alexandre-Xavier Labonté-Lamoureux
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// botclient.h
+// Clients without a window that join a game to measure how many players a server can handle
+
+#ifndef BOTCLIENT_H
+#define BOTCLIENT_H
+
+// Joins a game and plays with the bot or with the commands of a demo. Doesn't use OpenGL.
+int botclient(int argc, const char* argv[]);
+
+// Starts a bot client in as many processes as requested by '-swarm' and waits for them
+int swarm(int argc, const char* argv[]);
+
+#endif	// BOTCLIENT_H
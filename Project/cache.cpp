@@ -15,37 +15,410 @@
 //
 // cache.cpp
 // Cache that makes use of a map and manages the textures.
-// It uses the singleton pattern.
+// It uses the singleton pattern. Textures are reference counted and the
+// least recently used ones that are not referenced are evicted when the
+// memory budget is exceeded. In streaming mode, textures are decoded on a
+// background thread and uploaded a few at a time.
 
 #include "cache.h"
 #include "texture.h"
 
+#include <SDL2/SDL.h>	/* SDL_CreateRGBSurface, SDL_FreeSurface */
+
+#include <iostream>
+#include <list>
 #include <map>
 #include <string>
+#include <stdexcept>
+#include <thread>
+#include <mutex>
+#include <algorithm>	/* min, max */
 using namespace std;
 
 Cache* Cache::instance_ = nullptr;
 
+// Shrinks a surface with a box filter, so that its longest side is at most 'size'. Returns nullptr for the formats that textures don't support.
+static SDL_Surface* Shrink(const SDL_Surface* Surface, int size)
+{
+	int bpp = Surface->format->BytesPerPixel;
+
+	if (bpp != 3 && bpp != 4)
+		return nullptr;
+
+	int factor = max((Surface->w + size - 1) / size, (Surface->h + size - 1) / size);
+	int width = max(1, Surface->w / factor);
+	int height = max(1, Surface->h / factor);
+
+	SDL_Surface* Small = SDL_CreateRGBSurface(0, width, height, bpp * 8, Surface->format->Rmask, Surface->format->Gmask, Surface->format->Bmask, Surface->format->Amask);
+
+	if (!Small)
+		return nullptr;
+
+	const unsigned char* src = static_cast<const unsigned char*>(Surface->pixels);
+	unsigned char* dst = static_cast<unsigned char*>(Small->pixels);
+
+	for (int y = 0; y < height; y++)
+	{
+		for (int x = 0; x < width; x++)
+		{
+			// Average of the pixels that the small one covers
+			unsigned int sums[4] = {0, 0, 0, 0};
+			unsigned int count = 0;
+
+			for (int sy = y * factor; sy < min((y + 1) * factor, Surface->h); sy++)
+			{
+				for (int sx = x * factor; sx < min((x + 1) * factor, Surface->w); sx++)
+				{
+					const unsigned char* p = src + sy * Surface->pitch + sx * bpp;
+
+					for (int c = 0; c < bpp; c++)
+						sums[c] += p[c];
+
+					count++;
+				}
+			}
+
+			unsigned char* p = dst + y * Small->pitch + x * bpp;
+
+			for (int c = 0; c < bpp; c++)
+				p[c] = sums[c] / count;
+		}
+	}
+
+	return Small;
+}
+
 Cache::Cache()
 {
 	// Empty
 }
 
+void Cache::Load(Entry& e, const string& key)
+{
+	Insert(e, key, new Texture(key, e.filtering, !headless_));
+	misses_++;
+}
+
+void Cache::Insert(Entry& e, const string& key, Texture* texture)
+{
+	e.texture = texture;
+	e.requested = false;
+	resident_ += e.texture->Bytes();
+
+	lru_.push_front(key);
+	e.lru = lru_.begin();
+
+	Trim();
+}
+
+void Cache::Unload(Entry& e)
+{
+	resident_ -= e.texture->Bytes();
+	delete e.texture;
+	e.texture = nullptr;
+
+	lru_.erase(e.lru);
+}
+
+void Cache::Trim()
+{
+	if (budget_ == 0)
+		return;
+
+	// The most recently used texture is never evicted because it's about to be used
+	auto it = lru_.end();
+	while (resident_ > budget_ && it != lru_.begin() && --it != lru_.begin())
+	{
+		Entry& e = store_.at(*it);
+
+		if (e.references == 0)
+		{
+			cout << "Evicting texture " << *it << endl;
+			++it;	// The entry is removed from the list
+			Unload(e);
+		}
+	}
+}
+
 bool Cache::Add(const string& name, bool enableFiltering)
 {
-	if (store_.find(name) == store_.end())
+	lock_guard<recursive_mutex> guard(storeLock_);
+
+	auto found = store_.find(name);
+
+	if (found == store_.end())
+	{
+		Entry& e = store_[name];
+		e.filtering = enableFiltering;
+
+		try
+		{
+			Load(e, name);
+		}
+		catch (...)
+		{
+			store_.erase(name);
+			throw;
+		}
+
+		return true;
+	}
+
+	if (!found->second.texture)
 	{
-		store_.insert(pair<const string&, Texture*>(name, new Texture(name, enableFiltering)));
+		// It was evicted
+		Load(found->second, name);
 		return true;
 	}
 
 	return false;
 }
 
+void Cache::Acquire(const string& key, bool enableFiltering, bool load)
+{
+	lock_guard<recursive_mutex> guard(storeLock_);
+
+	if (load)
+	{
+		Add(key, enableFiltering);
+	}
+	else if (store_.find(key) == store_.end())
+	{
+		store_[key].filtering = enableFiltering;
+	}
+
+	store_.at(key).references++;
+}
+
+void Cache::Release(const string& key)
+{
+	lock_guard<recursive_mutex> guard(storeLock_);
+
+	auto found = store_.find(key);
+
+	if (found != store_.end() && found->second.references > 0)
+	{
+		found->second.references--;
+
+		// Textures are kept as long as the budget allows it. They may be used again by the next level.
+		if (found->second.references == 0)
+			Trim();
+	}
+}
+
 Texture* Cache::Get(const string& key)
 {
-	// Will throw 'std::out_of_range' if key is not found
-	return store_.at(key);
+	lock_guard<recursive_mutex> guard(storeLock_);
+
+	auto found = store_.find(key);
+
+	if (found == store_.end())
+	{
+		throw out_of_range("Texture '" + key + "' is not in the cache");
+	}
+
+	Entry& e = found->second;
+
+	if (e.texture)
+	{
+		// Move it in front of the LRU list
+		lru_.splice(lru_.begin(), lru_, e.lru);
+		hits_++;
+	}
+	else
+	{
+		Load(e, key);
+	}
+
+	return e.texture;
+}
+
+void Cache::SetHeadless()
+{
+	headless_ = true;
+}
+
+void Cache::SetStreaming(size_t uploadBudget)
+{
+	streaming_ = true;
+	uploadBudget_ = uploadBudget;
+}
+
+bool Cache::Streaming() const
+{
+	return streaming_;
+}
+
+void Cache::Request(const string& key)
+{
+	Entry& e = store_.at(key);
+
+	if (e.texture || e.requested)
+		return;
+
+	e.requested = true;
+
+	{
+		lock_guard<mutex> guard(lock_);
+		requests_.emplace_back(key, e.filtering);
+	}
+
+	wakeup_.notify_one();
+
+	if (!decoder_)
+		decoder_ = new thread(&Cache::Decoder, this);
+}
+
+bool Cache::Requested(const string& key) const
+{
+	auto found = store_.find(key);
+	return found != store_.end() && (found->second.texture || found->second.requested);
+}
+
+Texture* Cache::Peek(const string& key)
+{
+	auto found = store_.find(key);
+
+	if (found == store_.end() || !found->second.texture)
+		return nullptr;
+
+	lru_.splice(lru_.begin(), lru_, found->second.lru);
+	hits_++;
+
+	return found->second.texture;
+}
+
+Texture* Cache::Placeholder(const string& key)
+{
+	auto found = store_.find(key);
+
+	if (found != store_.end() && found->second.preview)
+		return found->second.preview;
+
+	if (!placeholder_)
+	{
+		// Small gray checkerboard that's shown until the real texture is uploaded
+		SDL_Surface* Surface = SDL_CreateRGBSurface(0, 2, 2, 24, 0x0000FF, 0x00FF00, 0xFF0000, 0);
+		unsigned char* pixels = static_cast<unsigned char*>(Surface->pixels);
+
+		for (int y = 0; y < 2; y++)
+		{
+			for (int x = 0; x < 2; x++)
+			{
+				unsigned char shade = (x + y) % 2 ? 96 : 128;
+				unsigned char* p = pixels + y * Surface->pitch + x * 3;
+				p[0] = p[1] = p[2] = shade;
+			}
+		}
+
+		placeholder_ = new Texture("placeholder", Surface, false);
+	}
+
+	return placeholder_;
+}
+
+void Cache::UploadPreview(Decoded& d)
+{
+	if (!d.preview)
+		return;
+
+	Entry& e = store_.at(d.name);
+
+	// Filtering hides that it's blurry. It was already uploaded if the texture was evicted and streamed again.
+	if (!e.preview)
+		e.preview = new Texture(d.name + " (preview)", d.preview, true);
+	else
+		SDL_FreeSurface(d.preview);
+
+	d.preview = nullptr;
+}
+
+// Runs on the main thread because OpenGL calls must be made from the thread that owns the context
+void Cache::Pump()
+{
+	size_t uploaded = 0;
+
+	// The low resolution versions are tiny, so they are all uploaded right away
+	{
+		lock_guard<mutex> guard(lock_);
+
+		for (Decoded& d : decoded_)
+		{
+			UploadPreview(d);
+		}
+	}
+
+	// Upload at least one texture per frame so that big textures are not stuck
+	while (uploaded == 0 || uploaded < uploadBudget_)
+	{
+		Decoded d;
+
+		{
+			lock_guard<mutex> guard(lock_);
+
+			if (decoded_.empty())
+				break;
+
+			d = decoded_.front();
+			decoded_.pop_front();
+		}
+
+		if (!d.error.empty())
+		{
+			throw runtime_error(d.error);
+		}
+
+		// It may have been decoded after the previews were uploaded
+		UploadPreview(d);
+
+		Entry& e = store_.at(d.name);
+
+		if (e.texture)
+		{
+			// It was loaded in the meantime
+			SDL_FreeSurface(d.surface);
+			continue;
+		}
+
+		Insert(e, d.name, new Texture(d.name, d.surface, e.filtering));
+		uploaded += e.texture->Bytes();
+		misses_++;
+	}
+}
+
+void Cache::Decoder()
+{
+	while (true)
+	{
+		pair<string, bool> request;
+
+		{
+			unique_lock<mutex> guard(lock_);
+			wakeup_.wait(guard, [this] { return quit_ || !requests_.empty(); });
+
+			if (quit_)
+				return;
+
+			request = requests_.front();
+			requests_.pop_front();
+		}
+
+		Decoded d;
+		d.name = request.first;
+
+		try
+		{
+			d.surface = Texture::Decode(d.name);
+			d.preview = Shrink(d.surface, PREVIEW_SIZE);
+		}
+		catch (const exception& e)
+		{
+			d.error = e.what();
+		}
+
+		lock_guard<mutex> guard(lock_);
+		decoded_.push_back(d);
+	}
 }
 
 unsigned int Cache::Size() const
@@ -53,6 +426,43 @@ unsigned int Cache::Size() const
 	return store_.size();
 }
 
+void Cache::SetBudget(size_t bytes)
+{
+	budget_ = bytes;
+	Trim();
+}
+
+size_t Cache::Budget() const
+{
+	return budget_;
+}
+
+size_t Cache::ResidentBytes() const
+{
+	return resident_;
+}
+
+unsigned int Cache::Hits() const
+{
+	return hits_;
+}
+
+unsigned int Cache::Misses() const
+{
+	return misses_;
+}
+
+void Cache::PrintStats() const
+{
+	cout << "Texture cache: " << lru_.size() << " of " << store_.size() << " textures resident ("
+		<< resident_ / 1024 << " KB";
+
+	if (budget_ > 0)
+		cout << " of " << budget_ / 1024 << " KB";
+
+	cout << "), " << hits_ << " hits, " << misses_ << " misses." << endl;
+}
+
 Cache* Cache::Instance()
 {
 	if (!instance_)
@@ -69,8 +479,29 @@ void Cache::DestroyInstance()
 // Destructor
 Cache::~Cache()
 {
+	if (decoder_)
+	{
+		{
+			lock_guard<mutex> guard(lock_);
+			quit_ = true;
+		}
+
+		wakeup_.notify_one();
+		decoder_->join();
+		delete decoder_;
+
+		for (unsigned int i = 0; i < decoded_.size(); i++)
+		{
+			SDL_FreeSurface(decoded_[i].surface);
+			SDL_FreeSurface(decoded_[i].preview);
+		}
+	}
+
 	// Iterate and delete elements of the map
 	for (auto& e: store_) {
-		delete e.second;
+		delete e.second.texture;
+		delete e.second.preview;
 	}
+
+	delete placeholder_;
 }
@@ -15,34 +15,114 @@
 //
 // cache.h
 // Cache that makes use of a map and manages the textures.
-// It uses the singleton pattern.
+// It uses the singleton pattern. Textures are reference counted and the
+// least recently used ones that are not referenced are evicted when the
+// memory budget is exceeded. In streaming mode, textures are decoded on a
+// background thread and uploaded a few at a time.
 
 #ifndef CACHE_H
 #define CACHE_H
 
 #include "texture.h"
 
+#include <cstddef>	/* size_t */
+#include <condition_variable>
+#include <deque>
+#include <list>
 #include <map>
+#include <mutex>
 #include <string>
+#include <thread>
 using namespace std;
 
+const int PREVIEW_SIZE = 16;	// Longest side of the low resolution textures that are shown while streaming
+
 class Cache
 {
 private:
-	map<string, Texture*> store_;
+	struct Entry
+	{
+		Texture* texture = nullptr;	// Null when evicted. It's loaded again on the next use.
+		bool filtering = false;
+		unsigned int references = 0;
+		bool requested = false;	// Waiting to be decoded or uploaded
+		Texture* preview = nullptr;	// Low resolution version. It's kept after the texture is evicted and doesn't count in the budget.
+		list<string>::iterator lru;	// Position in the LRU list, valid when the texture is resident
+	};
+
+	// Surface decoded by the background thread
+	struct Decoded
+	{
+		string name;
+		SDL_Surface* surface = nullptr;
+		SDL_Surface* preview = nullptr;	// Uploaded before the surface, without waiting for the upload budget
+		string error;
+	};
+
+	map<string, Entry> store_;
+	list<string> lru_;	// Resident textures, the most recently used first
+
+	size_t budget_ = 0;	// In bytes. Zero means that there's no limit.
+	size_t resident_ = 0;
+	unsigned int hits_ = 0;
+	unsigned int misses_ = 0;
+
+	bool headless_ = false;	// Textures are never uploaded
+	recursive_mutex storeLock_;	// Games on other threads create and delete things, which hold their sprites
+
+	// Streaming
+	bool streaming_ = false;
+	size_t uploadBudget_ = 0;	// Bytes uploaded per frame
+	Texture* placeholder_ = nullptr;
+	thread* decoder_ = nullptr;
+	mutex lock_;	// Protects the queues and 'quit_'
+	condition_variable wakeup_;
+	deque<pair<string, bool>> requests_;	// Name and filtering
+	deque<Decoded> decoded_;
+	bool quit_ = false;
 
 	static Cache* instance_;
 
 	Cache();
 	~Cache();	// Prevent unwanted destruction
 
+	void Load(Entry& e, const string& key);
+	void Insert(Entry& e, const string& key, Texture* texture);
+	void Unload(Entry& e);
+	void Trim();	// Evict textures until the budget is respected
+	void UploadPreview(Decoded& d);
+	void Decoder();	// Background thread
+
 public:
-	bool Add(const string& key, bool enableFiltering);
+	bool Add(const string& key, bool enableFiltering);	// Load without holding a reference
+
+	// Hold a reference so the texture can't be evicted. It's not loaded right away if 'load' is false.
+	void Acquire(const string& key, bool enableFiltering, bool load = true);
+	void Release(const string& key);
+
+	Texture* Get(const string& key);	// Loads the texture if it's not resident
 
-	Texture* Get(const string& key);
+	// Only the size of the textures is loaded. The game can run without OpenGL.
+	void SetHeadless();
+
+	// Streaming
+	void SetStreaming(size_t uploadBudget);
+	bool Streaming() const;
+	void Request(const string& key);	// Decode in the background
+	bool Requested(const string& key) const;	// Resident or about to be
+	Texture* Peek(const string& key);	// Null if not resident. Never loads.
+	Texture* Placeholder(const string& key);	// Low resolution version of a texture, or a checkerboard if it wasn't decoded yet
+	void Pump();	// Upload the textures that were decoded. Must be called once per frame.
 
 	unsigned int Size() const;
 
+	void SetBudget(size_t bytes);
+	size_t Budget() const;
+	size_t ResidentBytes() const;
+	unsigned int Hits() const;
+	unsigned int Misses() const;
+	void PrintStats() const;
+
 	string Previous() const;
 
 	static Cache* Instance();
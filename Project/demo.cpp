@@ -0,0 +1,773 @@
+// Copyright (C) 2020 Alexandre-Xavier Labonté-Lamoureux
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// demo.cpp
+// Recording and playback of demos. The commands are compressed in blocks and the state
+// of the game is saved at regular intervals so that a demo can start in the middle.
+
+#include "demo.h"
+
+#include <fcntl.h>		/* open */
+#include <unistd.h>		/* write, fdatasync, close */
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>		/* memcmp, memchr, strerror */
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+using namespace std;
+
+const unsigned int BLOCK_HEADER_SIZE = 20;
+
+// Read a little-endian 32-bit integer
+static unsigned int ReadLong(const unsigned char* p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+
+// Append a little-endian 32-bit integer
+static void PutLong(vector<unsigned char>& out, unsigned int value)
+{
+	const unsigned char bytes[4] = {(unsigned char)value, (unsigned char)(value >> 8), (unsigned char)(value >> 16), (unsigned char)(value >> 24)};
+	out.insert(out.end(), bytes, bytes + sizeof(bytes));
+}
+
+static void PutString(vector<unsigned char>& out, const string& text)
+{
+	PutLong(out, text.size());
+	out.insert(out.end(), text.begin(), text.end());
+}
+
+// Each byte is XORed with the same byte of the previous tic, so a command that doesn't change becomes zeros.
+// A control byte below 128 is followed by that many bytes plus one. Above it, it's a run of zeros of 'control - 127'.
+static void Encode(const vector<unsigned char>& commands, size_t size, unsigned int stride, vector<unsigned char>& encoded)
+{
+	auto delta = [&](size_t i) -> unsigned char
+	{
+		return commands[i] ^ (i >= stride ? commands[i - stride] : 0);
+	};
+
+	encoded.clear();
+	size_t i = 0;
+
+	while (i < size)
+	{
+		size_t run = 1;
+		bool zeros = delta(i) == 0;
+
+		while (i + run < size && run < 128 && (delta(i + run) == 0) == zeros)
+			run++;
+
+		if (zeros)
+		{
+			encoded.push_back(127 + run);
+		}
+		else
+		{
+			encoded.push_back(run - 1);
+
+			for (size_t j = 0; j < run; j++)
+				encoded.push_back(delta(i + j));
+		}
+
+		i += run;
+	}
+}
+
+// Returns false if the data doesn't decode to 'size' bytes
+static bool Decode(const unsigned char* encoded, size_t length, unsigned int stride, vector<unsigned char>& commands, size_t size)
+{
+	commands.resize(size);
+	size_t in = 0;
+	size_t out = 0;
+
+	while (in < length)
+	{
+		unsigned int control = encoded[in++];
+		bool zeros = control >= 128;
+		size_t run = zeros ? control - 127 : control + 1;
+
+		if (out + run > size || (!zeros && in + run > length))
+			return false;
+
+		for (size_t j = 0; j < run; j++, out++)
+		{
+			unsigned char previous = out >= stride ? commands[out - stride] : 0;
+			commands[out] = zeros ? previous : encoded[in++] ^ previous;
+		}
+	}
+
+	return out == size;
+}
+
+// Line of text that ends with a newline. Returns false if there's no newline.
+static bool ReadLine(const unsigned char* data, size_t size, size_t& pos, string& line)
+{
+	if (pos >= size)
+		return false;
+
+	const unsigned char* end = static_cast<const unsigned char*>(memchr(data + pos, '\n', size - pos));
+
+	if (!end)
+		return false;
+
+	line.assign(reinterpret_cast<const char*>(data + pos), end - (data + pos));
+	pos = end - data + 1;
+	return true;
+}
+
+/****************************** DemoWriter ******************************/
+
+DemoWriter::~DemoWriter()
+{
+	try
+	{
+		Close();
+	}
+	catch (const exception& e)
+	{
+		cerr << e.what() << endl;
+	}
+}
+
+void DemoWriter::Open(const string& path, const string& version, const string& level, unsigned short seed, unsigned int players, bool optimized)
+{
+	Close();
+
+	fd_ = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd_ < 0)
+	{
+		throw runtime_error("Could not open file '" + path + "' to write");
+	}
+
+	players_ = players;
+	tic_ = 0;
+	count_ = 0;
+	blockTic_ = 0;
+	offset_ = 0;
+	index_.clear();
+	quit_ = false;
+	failed_ = false;
+
+	out_.clear();
+	out_.insert(out_.end(), DEMO_MAGIC, DEMO_MAGIC + sizeof(DEMO_MAGIC));
+	PutLong(out_, DEMO_FORMAT);
+	PutLong(out_, players);
+	PutLong(out_, seed);
+	PutLong(out_, DEMO_KEYFRAME_INTERVAL);
+	PutLong(out_, optimized ? DEMO_OPTIMIZED : 0);
+	PutString(out_, version);
+	PutString(out_, level);
+	Output();
+
+	writer_ = new thread(&DemoWriter::Run, this);
+}
+
+bool DemoWriter::IsOpen() const
+{
+	return writer_ != nullptr;
+}
+
+void DemoWriter::Close()
+{
+	if (!writer_)
+		return;
+
+	// A tic that's not complete is dropped. The last checksums may be in a block without tics.
+	if (tic_ > blockTic_ || (block_ && !block_->sums.empty()))
+		Submit();
+
+	{
+		lock_guard<mutex> guard(lock_);
+		quit_ = true;
+	}
+
+	wakeup_.notify_one();
+	writer_->join();
+	delete writer_;
+	writer_ = nullptr;
+	block_ = nullptr;
+
+	if (failed_)
+	{
+		throw runtime_error(error_);
+	}
+}
+
+bool DemoWriter::NeedsKeyframe() const
+{
+	// The beginning of the demo is the beginning of the level, so it doesn't need one
+	return writer_ && count_ == 0 && tic_ > 0 && tic_ % DEMO_KEYFRAME_INTERVAL == 0 && (!block_ || block_->keyframe.empty());
+}
+
+void DemoWriter::Keyframe(const vector<unsigned char>& world)
+{
+	if (!block_)
+		Acquire();
+
+	block_->keyframe = world;
+}
+
+void DemoWriter::Write(const Ticcmd& cmd)
+{
+	if (!block_)
+		Acquire();
+
+	cmd.Pack(&block_->commands[((tic_ - blockTic_) * players_ + count_) * TICCMD_SIZE]);
+
+	if (++count_ == players_)
+	{
+		count_ = 0;
+		tic_++;
+
+		if (tic_ - blockTic_ == DEMO_BLOCK_TICS)
+			Submit();
+	}
+}
+
+void DemoWriter::Write(const vector<Player*>& players)
+{
+	for (unsigned int i = 0; i < players.size(); i++)
+	{
+		Write(players[i]->Cmd);
+	}
+}
+
+void DemoWriter::Checksum(unsigned int tic, unsigned int sum)
+{
+	if (!block_)
+		Acquire();
+
+	block_->sums.push_back({tic, sum});
+}
+
+void DemoWriter::Acquire()
+{
+	if (failed_)
+	{
+		throw runtime_error(error_);
+	}
+
+	while (!(block_ = blocks_.Back()))
+	{
+		wakeup_.notify_one();
+		this_thread::sleep_for(chrono::milliseconds(1));
+	}
+
+	block_->commands.resize(DEMO_BLOCK_TICS * players_ * TICCMD_SIZE);
+	block_->keyframe.clear();
+	block_->sums.clear();
+}
+
+void DemoWriter::Submit()
+{
+	if (!block_)
+		Acquire();
+
+	block_->tic = blockTic_;
+	block_->tics = tic_ - blockTic_;
+	blocks_.Push();
+	block_ = nullptr;
+	blockTic_ = tic_;
+
+	{
+		lock_guard<mutex> guard(lock_);
+	}
+
+	wakeup_.notify_one();
+}
+
+void DemoWriter::Run()
+{
+	auto synced = chrono::steady_clock::now();
+
+	try
+	{
+		while (true)
+		{
+			const Block* block = blocks_.Front();
+
+			if (!block)
+			{
+				unique_lock<mutex> guard(lock_);
+
+				if (quit_ && !blocks_.Front())
+					break;
+
+				wakeup_.wait_for(guard, chrono::milliseconds(DEMO_SYNC_INTERVAL), [this] { return quit_ || blocks_.Front(); });
+				continue;
+			}
+
+			Store(*block);
+			blocks_.Pop();
+
+			if (chrono::steady_clock::now() - synced >= chrono::milliseconds(DEMO_SYNC_INTERVAL))
+			{
+				fdatasync(fd_);
+				synced = chrono::steady_clock::now();
+			}
+		}
+
+		// The index makes the keyframes quick to find. Without it, the reader has to scan the blocks.
+		out_.clear();
+		out_.insert(out_.end(), DEMO_INDEX_MAGIC, DEMO_INDEX_MAGIC + sizeof(DEMO_INDEX_MAGIC));
+		PutLong(out_, index_.size());
+
+		for (unsigned int i = 0; i < index_.size(); i++)
+		{
+			PutLong(out_, index_[i].first);
+			PutLong(out_, index_[i].second);
+		}
+
+		PutLong(out_, offset_);
+		Output();
+		fdatasync(fd_);
+	}
+	catch (const exception& e)
+	{
+		error_ = e.what();
+		failed_ = true;
+	}
+
+	close(fd_);
+	fd_ = -1;
+}
+
+void DemoWriter::Store(const Block& block)
+{
+	Encode(block.commands, block.tics * players_ * TICCMD_SIZE, players_ * TICCMD_SIZE, encoded_);
+
+	if (!block.keyframe.empty())
+		index_.push_back({block.tic, (unsigned int)offset_});
+
+	out_.clear();
+	PutLong(out_, block.tic);
+	PutLong(out_, block.tics);
+	PutLong(out_, block.keyframe.size());
+	PutLong(out_, encoded_.size());
+	PutLong(out_, block.sums.size());
+
+	for (unsigned int i = 0; i < block.sums.size(); i++)
+	{
+		PutLong(out_, block.sums[i].first);
+		PutLong(out_, block.sums[i].second);
+	}
+
+	out_.insert(out_.end(), block.keyframe.begin(), block.keyframe.end());
+	out_.insert(out_.end(), encoded_.begin(), encoded_.end());
+	Output();
+}
+
+void DemoWriter::Output()
+{
+	size_t done = 0;
+
+	while (done < out_.size())
+	{
+		ssize_t written = write(fd_, out_.data() + done, out_.size() - done);
+
+		if (written < 0)
+		{
+			if (errno == EINTR)
+				continue;
+
+			throw runtime_error("Could not write the demo: " + string(strerror(errno)));
+		}
+
+		done += written;
+	}
+
+	offset_ += out_.size();
+}
+
+/****************************** DemoReader ******************************/
+
+void DemoReader::Open(const string& path)
+{
+	Close();
+
+	file_ = Resources::Instance()->Open(path);
+	if (!file_.IsOpen())
+	{
+		throw runtime_error("Could not open demo '" + path + "'");
+	}
+
+	const unsigned char* data = file_.Data();
+	size_t size = file_.Size();
+	file_.Sequential();
+
+	if (size >= sizeof(DEMO_MAGIC) && memcmp(data, DEMO_MAGIC, sizeof(DEMO_MAGIC)) == 0)
+	{
+		const size_t HEADER_SIZE = sizeof(DEMO_MAGIC) + 7 * 4;	// Up to the length of the version
+
+		if (size < HEADER_SIZE)
+			throw runtime_error("Demo '" + path + "' is damaged");
+
+		format_ = ReadLong(data + 4);
+
+		if (format_ != DEMO_FORMAT)
+			throw runtime_error("Demo '" + path + "' has format " + to_string(format_) + ", expected format " + to_string(DEMO_FORMAT));
+
+		players_ = ReadLong(data + 8);
+		seed_ = ReadLong(data + 12);
+
+		if (ReadLong(data + 16) % DEMO_BLOCK_TICS != 0)
+			throw runtime_error("Demo '" + path + "' has keyframes that are not at the beginning of a block");
+
+		optimized_ = (ReadLong(data + 20) & DEMO_OPTIMIZED) != 0;
+
+		size_t pos = 24;
+		unsigned int length = ReadLong(data + pos);
+
+		if (pos + 4 + length + 4 > size)
+			throw runtime_error("Demo '" + path + "' is damaged");
+
+		version_.assign(reinterpret_cast<const char*>(data + pos + 4), length);
+		pos += 4 + length;
+		length = ReadLong(data + pos);
+
+		if (pos + 4 + length > size)
+			throw runtime_error("Demo '" + path + "' is damaged");
+
+		level_.assign(reinterpret_cast<const char*>(data + pos + 4), length);
+		start_ = pos + 4 + length;
+
+		ReadIndex();
+	}
+	else
+	{
+		// Version, level, seed and number of players, one per line
+		format_ = 1;
+		string seed, players;
+		size_t pos = 0;
+
+		if (!ReadLine(data, size, pos, version_) || !ReadLine(data, size, pos, level_) ||
+			!ReadLine(data, size, pos, seed) || !ReadLine(data, size, pos, players))
+		{
+			throw runtime_error("Demo '" + path + "' has an incomplete header");
+		}
+
+		seed_ = stoi(seed);
+		players_ = stoul(players);
+		optimized_ = false;
+		start_ = pos;
+		end_ = size;
+	}
+
+	next_ = start_;
+	prefetched_ = start_;
+	summed_ = start_;
+	sums_.clear();
+	nextSum_ = 0;
+	tic_ = 0;
+	blockTic_ = 0;
+	blockTics_ = 0;
+}
+
+bool DemoReader::IsOpen() const
+{
+	return file_.IsOpen();
+}
+
+void DemoReader::Close()
+{
+	file_ = Lump();
+	index_.clear();
+	commands_.clear();
+	format_ = 0;
+}
+
+void DemoReader::ReadIndex()
+{
+	const unsigned char* data = file_.Data();
+	size_t size = file_.Size();
+	index_.clear();
+
+	if (size >= start_ + 4)
+	{
+		size_t index = ReadLong(data + size - 4);
+
+		if (index >= start_ && index + 8 <= size - 4 && memcmp(data + index, DEMO_INDEX_MAGIC, sizeof(DEMO_INDEX_MAGIC)) == 0)
+		{
+			unsigned int count = ReadLong(data + index + 4);
+
+			if (index + 8 + (size_t)count * 8 <= size - 4)
+			{
+				bool valid = true;
+
+				// Each keyframe must be in a block before the index, in the order of the tics
+				for (unsigned int i = 0; i < count && valid; i++)
+				{
+					unsigned int tic = ReadLong(data + index + 8 + i * 8);
+					size_t offset = ReadLong(data + index + 12 + i * 8);
+
+					valid = offset >= start_ && offset + BLOCK_HEADER_SIZE <= index && ReadLong(data + offset) == tic &&
+						(index_.empty() || tic > index_.back().first) &&
+						offset + BLOCK_HEADER_SIZE + (size_t)ReadLong(data + offset + 16) * 8 + ReadLong(data + offset + 8) <= index;
+
+					index_.push_back({tic, offset});
+				}
+
+				if (valid)
+				{
+					end_ = index;
+					return;
+				}
+
+				index_.clear();
+				cerr << "WARNING: demo has a damaged index, the blocks will be scanned" << endl;
+			}
+		}
+	}
+
+	// Only the blocks that are complete can be played
+	size_t pos = start_;
+
+	while (pos + BLOCK_HEADER_SIZE <= size && memcmp(data + pos, DEMO_INDEX_MAGIC, sizeof(DEMO_INDEX_MAGIC)) != 0)
+	{
+		size_t length = BLOCK_HEADER_SIZE + (size_t)ReadLong(data + pos + 16) * 8 + ReadLong(data + pos + 8) + ReadLong(data + pos + 12);
+
+		if (pos + length > size)
+			break;
+
+		if (ReadLong(data + pos + 8) > 0)
+			index_.push_back({ReadLong(data + pos), pos});
+
+		pos += length;
+	}
+
+	end_ = pos;
+
+	if (pos + sizeof(DEMO_INDEX_MAGIC) > size || memcmp(data + pos, DEMO_INDEX_MAGIC, sizeof(DEMO_INDEX_MAGIC)) != 0)
+		cerr << "WARNING: demo was not closed properly, it will end where it was cut off" << endl;
+}
+
+bool DemoReader::ReadBlock()
+{
+	const unsigned char* data = file_.Data();
+
+	if (next_ + BLOCK_HEADER_SIZE > end_)
+		return false;
+
+	ReadAhead();
+
+	const unsigned char* block = data + next_;
+	size_t sums = (size_t)ReadLong(block + 16) * 8;
+	unsigned int keyframe = ReadLong(block + 8);
+	unsigned int length = ReadLong(block + 12);
+
+	if (next_ + BLOCK_HEADER_SIZE + sums + keyframe + length > end_)
+		throw runtime_error("Demo is damaged at offset " + to_string(next_));
+
+	blockTic_ = ReadLong(block);
+	blockTics_ = ReadLong(block + 4);
+
+	if (!Decode(block + BLOCK_HEADER_SIZE + sums + keyframe, length, players_ * TICCMD_SIZE, commands_, (size_t)blockTics_ * players_ * TICCMD_SIZE))
+		throw runtime_error("Demo is damaged at tic " + to_string(blockTic_));
+
+	next_ += BLOCK_HEADER_SIZE + sums + keyframe + length;
+	tic_ = blockTic_;
+
+	// The checksums of the last tics of this block are in the next one
+	ReadSums(next_ + 1);
+	return true;
+}
+
+void DemoReader::ReadSums(size_t until)
+{
+	const unsigned char* data = file_.Data();
+
+	// The ones that were used are dropped, so the vector stays small
+	sums_.erase(sums_.begin(), sums_.begin() + nextSum_);
+	nextSum_ = 0;
+
+	while (summed_ < until && summed_ + BLOCK_HEADER_SIZE <= end_)
+	{
+		const unsigned char* block = data + summed_;
+		unsigned int count = ReadLong(block + 16);
+		size_t length = BLOCK_HEADER_SIZE + (size_t)count * 8 + ReadLong(block + 8) + ReadLong(block + 12);
+
+		if (summed_ + length > end_)
+			throw runtime_error("Demo is damaged at offset " + to_string(summed_));
+
+		for (unsigned int i = 0; i < count; i++)
+			sums_.push_back({ReadLong(block + BLOCK_HEADER_SIZE + i * 8), ReadLong(block + BLOCK_HEADER_SIZE + i * 8 + 4)});
+
+		summed_ += length;
+	}
+}
+
+// Ask for the next part of the demo before it's needed, so the playback doesn't wait for the disk
+void DemoReader::ReadAhead()
+{
+	if (next_ + DEMO_READ_AHEAD / 2 >= prefetched_ && prefetched_ < end_)
+	{
+		file_.Prefetch(prefetched_, DEMO_READ_AHEAD);
+		prefetched_ += DEMO_READ_AHEAD;
+	}
+}
+
+const unsigned char* DemoReader::ReadTic()
+{
+	unsigned int stride = players_ * TICCMD_SIZE;
+
+	if (format_ == 1)
+	{
+		// The commands are used where they are mapped
+		if (next_ + stride > end_)
+		{
+			if (next_ < end_)
+				cerr << "WARNING: demo ended prematurely" << endl;
+
+			return nullptr;
+		}
+
+		const unsigned char* commands = file_.Data() + next_;
+		next_ += stride;
+		tic_++;
+		ReadAhead();
+		return commands;
+	}
+
+	while (tic_ >= blockTic_ + blockTics_)
+	{
+		if (!ReadBlock())
+			return nullptr;
+	}
+
+	return &commands_[(size_t)(tic_++ - blockTic_) * stride];
+}
+
+unsigned int DemoReader::Format() const
+{
+	return format_;
+}
+
+const string& DemoReader::Version() const
+{
+	return version_;
+}
+
+const string& DemoReader::Level() const
+{
+	return level_;
+}
+
+unsigned short DemoReader::Seed() const
+{
+	return seed_;
+}
+
+unsigned int DemoReader::Players() const
+{
+	return players_;
+}
+
+bool DemoReader::Optimized() const
+{
+	return optimized_;
+}
+
+unsigned int DemoReader::Tic() const
+{
+	return tic_;
+}
+
+bool DemoReader::Read(const vector<Player*>& players)
+{
+	const unsigned char* commands = ReadTic();
+
+	if (!commands)
+		return false;
+
+	for (unsigned int i = 0; i < players.size() && i < players_; i++)
+	{
+		players[i]->Cmd.Unpack(commands + i * TICCMD_SIZE);
+	}
+
+	return true;
+}
+
+bool DemoReader::Read(unsigned int player, Ticcmd& cmd)
+{
+	const unsigned char* commands = ReadTic();
+
+	if (!commands)
+		return false;
+
+	cmd.Unpack(commands + player * TICCMD_SIZE);
+	return true;
+}
+
+bool DemoReader::Read(Ticcmd* cmds)
+{
+	const unsigned char* commands = ReadTic();
+
+	if (!commands)
+		return false;
+
+	for (unsigned int i = 0; i < players_; i++)
+	{
+		cmds[i].Unpack(commands + i * TICCMD_SIZE);
+	}
+
+	return true;
+}
+
+bool DemoReader::Checksum(unsigned int tic, unsigned int& sum)
+{
+	// The older ones were skipped
+	while (nextSum_ < sums_.size() && sums_[nextSum_].first <= tic)
+	{
+		if (sums_[nextSum_++].first == tic)
+		{
+			sum = sums_[nextSum_ - 1].second;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+unsigned int DemoReader::Seek(unsigned int tic, const unsigned char*& world, size_t& size)
+{
+	world = nullptr;
+	size = 0;
+	next_ = start_;
+	tic_ = 0;
+
+	for (unsigned int i = 0; i < index_.size() && index_[i].first <= tic; i++)
+	{
+		next_ = index_[i].second;
+		tic_ = index_[i].first;
+	}
+
+	if (tic_ > 0)
+	{
+		const unsigned char* block = file_.Data() + next_;
+		world = block + BLOCK_HEADER_SIZE + (size_t)ReadLong(block + 16) * 8;
+		size = ReadLong(block + 8);
+	}
+
+	blockTic_ = tic_;
+	blockTics_ = 0;
+	prefetched_ = next_;
+	summed_ = next_;
+	sums_.clear();
+	nextSum_ = 0;
+	return tic_;
+}
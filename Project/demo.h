@@ -0,0 +1,184 @@
+// Copyright (C) 2020 Alexandre-Xavier Labonté-Lamoureux
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// demo.h
+// Recording and playback of demos. The commands are compressed in blocks and the state
+// of the game is saved at regular intervals so that a demo can start in the middle.
+
+#ifndef DEMO_H
+#define DEMO_H
+
+#include "ticcmd.h"
+#include "player.h"
+#include "archive.h"	/* Lump, Resources */
+#include "ring.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>	/* pair */
+#include <vector>
+using namespace std;
+
+// Demo format 2. Integers are 32 bits and little-endian.
+//   Header:  "MGDM", format, number of players, seed, keyframe interval, flags, then the version of the game and the level's name
+//   Blocks:  first tic, number of tics, size of the keyframe, size of the commands, number of checksums,
+//            then the checksums (tic and checksum of the state after it), the keyframe and the commands
+//   Index:   "MGDX", number of keyframes, then the tic and the offset of each block that has a keyframe
+//   Trailer: offset of the index
+// A keyframe is a world snapshot of the state before the first tic of its block. The commands
+// of each player are XORed with the ones of the previous tic, then the runs of zeros are shortened.
+// A checksum is known once its tic ran, so it's in the block that was being filled at that time,
+// which is the block of its tic or the next one.
+// Format 1 is a text header (version, level, seed, players) followed by the commands, uncompressed.
+// Its levels were never optimized.
+const char DEMO_MAGIC[4] = {'M', 'G', 'D', 'M'};
+const char DEMO_INDEX_MAGIC[4] = {'M', 'G', 'D', 'X'};
+const unsigned int DEMO_FORMAT = 2;
+const unsigned int DEMO_BLOCK_TICS = 128;
+const unsigned int DEMO_OPTIMIZED = 1;	// Flag. The level was welded and its planes were merged, which changes the collisions.
+const unsigned int DEMO_KEYFRAME_INTERVAL = 1024;	// About 17 seconds. Must be a multiple of the size of a block.
+const unsigned int DEMO_CHECKSUM_INTERVAL = 16;	// Tics between the checksums that are recorded
+const unsigned int DEMO_QUEUE_BLOCKS = 16;	// Blocks that can wait to be written
+const int DEMO_SYNC_INTERVAL = 1000;	// ms between the times the written blocks are forced to the disk
+const size_t DEMO_READ_AHEAD = 256 * 1024;	// Bytes that are loaded ahead of the playback
+
+// Commands are copied into blocks in memory. A background thread compresses the blocks that are
+// complete and writes them to the disk, so a demo cut off by a crash can be played up to the last one.
+class DemoWriter
+{
+private:
+	struct Block
+	{
+		unsigned int tic = 0;	// First tic
+		unsigned int tics = 0;
+		vector<unsigned char> commands;	// Packed. Allocated once for every slot.
+		vector<unsigned char> keyframe;	// State before the first tic, empty if there's none
+		vector<pair<unsigned int, unsigned int>> sums;	// Tic and checksum
+	};
+
+	unsigned int players_ = 0;
+	unsigned int tic_ = 0;	// Tic of the next command
+	unsigned int count_ = 0;	// Commands of the next tic that were written
+	unsigned int blockTic_ = 0;	// First tic of the current block
+	Block* block_ = nullptr;	// Block being filled, a slot of the queue
+
+	// Game thread to the background thread
+	Ring<Block, DEMO_QUEUE_BLOCKS> blocks_;
+	thread* writer_ = nullptr;
+	mutex lock_;	// Protects 'quit_' for the wakeups
+	condition_variable wakeup_;
+	bool quit_ = false;
+	atomic<bool> failed_{false};
+	string error_;	// Set before 'failed_'
+
+	// Background thread only
+	int fd_ = -1;
+	size_t offset_ = 0;	// Size of the file
+	vector<unsigned char> out_;	// Next thing to write, reused
+	vector<unsigned char> encoded_;
+	vector<pair<unsigned int, unsigned int>> index_;	// Tic and offset of the blocks with a keyframe
+
+	void Acquire();	// Get an empty block. Waits if the disk doesn't keep up.
+	void Submit();	// Give the current block to the background thread
+	void Run();	// Background thread
+	void Store(const Block& block);
+	void Output();	// Write 'out_' to the file
+
+public:
+	DemoWriter() = default;
+	DemoWriter(const DemoWriter&) = delete;
+	DemoWriter& operator=(const DemoWriter&) = delete;
+	~DemoWriter();
+
+	// Throws if the file can't be created
+	void Open(const string& path, const string& version, const string& level, unsigned short seed, unsigned int players, bool optimized);
+	bool IsOpen() const;
+	void Close();	// Writes the last commands and the index. Throws if writing failed.
+
+	// True when the next tic begins a block that should start with a keyframe
+	bool NeedsKeyframe() const;
+	void Keyframe(const vector<unsigned char>& world);
+
+	// Commands are written in the order of the players. A tic is complete once every player has one.
+	// Throws if the background thread could not write the demo.
+	void Write(const Ticcmd& cmd);
+	void Write(const vector<Player*>& players);
+
+	// Checksum of the state after a tic, so that the playback can find a desync
+	void Checksum(unsigned int tic, unsigned int sum);
+};
+
+// Reads the demo where it's mapped in memory. The system is asked to load it ahead of the playback.
+class DemoReader
+{
+private:
+	Lump file_;
+	unsigned int format_ = 0;
+	string version_;
+	string level_;
+	unsigned short seed_ = 0;
+	unsigned int players_ = 0;
+	bool optimized_ = false;
+	size_t start_ = 0;	// Offset of the first block or command
+	size_t end_ = 0;	// End of the blocks or commands
+	size_t prefetched_ = 0;	// End of the part that was requested from the disk
+	vector<pair<unsigned int, unsigned int>> index_;	// Tic and offset of the blocks with a keyframe
+
+	unsigned int tic_ = 0;	// Next tic
+	size_t next_ = 0;	// Offset of the next block, or of the next command for format 1
+	unsigned int blockTic_ = 0;	// First tic of the current block
+	unsigned int blockTics_ = 0;
+	vector<unsigned char> commands_;	// Commands of the current block, packed
+	vector<pair<unsigned int, unsigned int>> sums_;	// Checksums that were read and not used yet, tic and checksum
+	size_t nextSum_ = 0;	// Index in 'sums_'
+	size_t summed_ = 0;	// Offset of the first block whose checksums were not read
+
+	void ReadIndex();	// Scans the blocks if the index is missing, like when the game crashed during the recording
+	bool ReadBlock();
+	void ReadAhead();
+	void ReadSums(size_t until);	// Checksums of the blocks before offset 'until'
+	const unsigned char* ReadTic();	// Packed commands of every player for the next tic, nullptr at the end
+
+public:
+	// Reads the header. Throws if the demo can't be opened.
+	void Open(const string& path);
+	bool IsOpen() const;
+	void Close();
+
+	unsigned int Format() const;
+	const string& Version() const;
+	const string& Level() const;
+	unsigned short Seed() const;
+	unsigned int Players() const;
+	bool Optimized() const;	// The level must be optimized the same way to play the demo
+	unsigned int Tic() const;	// Next tic to read
+
+	// Give the commands of the next tic to the players. Returns false at the end of the demo.
+	bool Read(const vector<Player*>& players);
+	bool Read(unsigned int player, Ticcmd& cmd);	// Only the command of one player
+	bool Read(Ticcmd* cmds);	// One command for each player of the demo
+
+	// Checksum of the state after 'tic', if the demo has one. The tics must be asked in order. Format 1 has no checksums.
+	bool Checksum(unsigned int tic, unsigned int& sum);
+
+	// Go to the last keyframe at or before 'tic', or to the beginning of the demo. Returns the tic of the keyframe.
+	// 'world' points to the snapshot in the demo, or is nullptr if there's none. Format 1 has no keyframes.
+	unsigned int Seek(unsigned int tic, const unsigned char*& world, size_t& size);
+};
+
+#endif	// DEMO_H
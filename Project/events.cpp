@@ -27,48 +27,20 @@
 #include <iostream>
 using namespace std;
 
-// Write each player's tic in the demo file
-void writeCmdToDemo(ofstream& demo, const vector<Player*>& players)
+// Line: tic, player number and the message
+void writeChatToDemo(ofstream& chat, const ChatMessage& message)
 {
-	vector<unsigned char> command;
-
-	for (unsigned int i = 0; i < players.size(); i++)
-	{
-		command = players[i]->CmdToNet();
-
-		if (command.size() >= BYTES_TO_READ)
-		{
-			// Write everything except the chat string and its lenght
-			demo.write(reinterpret_cast<char*>(command.data()), BYTES_TO_READ);
-		}
-		else
-		{
-			cerr << string(__FUNCTION__) << ": Tried to read more bytes than the command size." << endl;
-		}
-	}
+	chat << message.tic << ' ' << message.player << ' ' << message.text << '\n';
 }
 
-// Read a tic from the demo and updates each player
-// Returns false if demo must be ended
-bool readCmdFromDemo(ifstream& demo, vector<Player*> players)
+bool readChatFromDemo(istream& chat, ChatMessage& message)
 {
-	vector<unsigned char> command;
-	command.resize(8, 0);	// '8' because the chat string size is '0'
-
-	// Demo Play is True
-	for (unsigned int i = 0; i < players.size(); i++)
-	{
-		// Read 7 bytes (BYTES_TO_READ) from the demo file and write them to the command vector
-		demo.read(reinterpret_cast<char*>(command.data()), BYTES_TO_READ);
+	if (!(chat >> message.tic >> message.player))
+		return false;
 
-		if (!demo)
-		{
-			cerr << "WARNING: demo ended prematurely" << endl;
-			return false;
-		}
-
-		players[i]->NetToCmd(command);
-	}
+	// Skip the space before the message
+	chat.get();
+	getline(chat, message.text);
 
 	return true;
 }
@@ -22,16 +22,12 @@
 #include <GLFW/glfw3.h>
 
 #include <fstream>
+#include <istream>
 using namespace std;
 
-// Number of bytes from the beginning of a tic command that are important for a demo
-const unsigned int BYTES_TO_READ = 7;
-
-// Write each player's tic in the demo file
-void writeCmdToDemo(ofstream& demo, const vector<Player*>& players);
-
-// Read a tic from the demo and updates each player
-bool readCmdFromDemo(ifstream& demo, vector<Player*> players);
+// Chat messages are in a separate file, one per line
+void writeChatToDemo(ofstream& chat, const ChatMessage& message);
+bool readChatFromDemo(istream& chat, ChatMessage& message);	// Returns false at the end of the file
 
 // Takes keyboard and mouse events and applies them to the player
 void updatePlayerWithEvents(GLFWwindow* window, GameWindow& view, unsigned int TicCount, Player* play);
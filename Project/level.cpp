@@ -23,24 +23,30 @@
 #include "plane.h"	/* Plane */
 #include "cache.h"	/* Cache */
 #include "physics.h"	/* AdjustPlayerToFloor, PlayerToPlayersCollision */
-#include "random.h"	/* Rand() */
+#include "random.h"	/* Rand(), GetIndex(), SetIndex() */
 #include "strutils.h"
+#include "archive.h"	/* LumpStream */
+#include "optimize.h"	/* WeldVertices, MergePlanes */
 
 #include <vector>
 #include <string>
 #include <iostream>	/* cout */
-#include <fstream>	/* ifstream */
-#include <sstream>	/* istringstream */
+#include <sstream>	/* istringstream, ostringstream */
 #include <iterator>	/* istream_iterator */
+#include <algorithm>	/* find, max */
+#include <cmath>	/* sqrt */
+#include <iomanip>	/* setprecision */
 #include <chrono>
 #include <stdexcept>
+#include <cstring>	/* memcpy, memcmp */
 using namespace std;
 
-Level::Level(const string& level, float scaling, unsigned int numOfPlayers)
+Level::Level(const string& level, float scaling, unsigned int numOfPlayers, bool optimize)
 {
 	auto start = chrono::system_clock::now();
 	levelname_ = level;
 	scaling_ = scaling;
+	optimize_ = optimize;
 	LoadLevel(level, numOfPlayers);
 	auto end = chrono::system_clock::now();
 	auto diff = chrono::duration_cast<chrono::milliseconds>(end - start).count();
@@ -55,29 +61,38 @@ Level::~Level()
 		delete things[i];
 	}
 
-	// Delete planes
-	for (unsigned int i = 0; i < planes.size(); i++)
-	{
-		delete planes[i];
-	}
-
-	// Delete the cache instance and its contents
-	Cache::Instance()->DestroyInstance();
+	// The textures stay in the cache so they can be reused by the next level
+	ReleaseTextures(textures_);
 }
 
 void Level::Reload()
 {
-	// Delete planes from memory
-	for (unsigned int i = 0; i < planes.size(); i++)
-	{
-		delete planes[i];
-	}
-
 	// Delete planes from level
 	planes.clear();
+	vertices.clear();
+	uvs.clear();
+	unstreamed_.clear();
+
+	// Hold the previous references until the level is loaded so that the textures are not evicted in between
+	vector<string> previous;
+	previous.swap(textures_);
+	lastTextureId_ = NO_TEXTURE;	// The IDs will change
+
 	// Load level
 	reloaded_ = true;
 	LoadLevel(levelname_, players.size());
+
+	ReleaseTextures(previous);
+}
+
+void Level::ReleaseTextures(vector<string>& textures)
+{
+	for (unsigned int i = 0; i < textures.size(); i++)
+	{
+		Cache::Instance()->Release(textures[i]);
+	}
+
+	textures.clear();
 }
 
 // Update game entities
@@ -95,6 +110,477 @@ void Level::UpdateThings()
 	}
 }
 
+// Run the game logic for one tic using the players' commands
+void Level::RunTic()
+{
+	// The things are drawn between their positions before and after this tic
+	for (unsigned int i = 0; i < things.size(); i++)
+	{
+		things[i]->Remember();
+	}
+
+	for (unsigned int i = 0; i < players.size(); i++)
+	{
+		// Save player's position and the execute the tic command
+		Float3 pt = players[i]->pos_;
+		players[i]->ExecuteTick();
+
+		// Collision detection with floors and walls
+		if (!NewPositionIsValid(players[i], this))
+		{
+			// Compute the position where the player would be if he slide against the wall
+			Float2 pos = MoveOnCollision(pt, players[i]->pos_, players[i], this);
+
+			// Move the player back to its original position
+			// TODO: Shouldn't any 'momentum' be cancelled?
+			players[i]->pos_ = pt;
+
+			// Try to slide the player against the walls to a valid position
+			if (NewPositionIsValid(players[i], this))
+			{
+				// Make sure the walls didn't push the player inside other players
+				if (!PlayerToPlayersCollision(players[i], players))
+				{
+					// Set the new position
+					players[i]->pos_.x = pos.x;
+					players[i]->pos_.y = pos.y;
+				}
+				else
+				{
+					// TODO: Shouldn't any 'momentum' be cancelled?
+					players[i]->pos_ = pt;
+				}
+			}
+		}
+
+		// Player to player collision check
+		if (PlayerToPlayersCollision(players[i], players))
+		{
+			for (unsigned int j = 0; j < players.size(); j++)
+			{
+				if (players[i] != players[j])
+				{
+					// Execute Player to player collision
+					players[i]->pos_ = PlayerToPlayerCollisionReact(players[i], players[j]);
+					// Check if there's a collision between players
+					if (PlayerToPlayerCollision(players[i], players[j]) ||
+						!NewPositionIsValid(players[i], this))
+					{
+						// Restore original position
+						players[i]->pos_ = pt;
+					}
+				}
+			}
+		}
+
+		// Adjust height
+		AdjustPlayerToFloor(players[i], this);
+
+		// Handle fire here to avoid circular inclusion/dependecy with 'Level' in the Player class
+		if (players[i]->ShouldFire)
+		{
+			Hitscan(this, players[i], players);
+			players[i]->ShouldFire = false;
+		}
+	}
+
+	UpdateThings();
+
+}
+
+// The buffer was made large enough before
+template <typename T>
+static void Put(unsigned char* world, size_t& pos, const T& value)
+{
+	memcpy(world + pos, &value, sizeof(T));
+	pos += sizeof(T);
+}
+
+template <typename T>
+static void Get(const unsigned char* world, size_t size, size_t& pos, T& value)
+{
+	if (pos + sizeof(T) > size)
+		throw runtime_error("World snapshot is truncated");
+
+	memcpy(&value, world + pos, sizeof(T));
+	pos += sizeof(T);
+}
+
+// Planes are written as their index because the level is loaded again when the snapshot is read
+static int PlaneIndex(const Plane* plane, const vector<Plane>& planes)
+{
+	return plane ? static_cast<int>(plane - planes.data()) : -1;
+}
+
+static Plane* PlaneAt(int index, vector<Plane>& planes)
+{
+	if (index < -1 || index >= static_cast<int>(planes.size()))
+		throw runtime_error("World snapshot has an invalid plane");
+
+	return index < 0 ? nullptr : &planes[index];
+}
+
+void Level::SaveWorld(vector<unsigned char>& world, unsigned int tic) const
+{
+	unsigned int persistent = weapons.size() + players.size();
+
+	// Large enough for anything, then cut to what was written. The state of a player is larger in memory than in the snapshot.
+	const size_t HEADER_SIZE = sizeof(WORLD_MAGIC) + 6 * sizeof(unsigned int) + sizeof(unsigned short);
+	const size_t THING_SIZE = sizeof(ThingKind) + 2 * sizeof(Float3) + sizeof(int) + sizeof(int) + 2 * sizeof(float);	// Blood is the largest
+	world.resize(HEADER_SIZE + players.size() * sizeof(PlayerState) + (things.size() - persistent) * THING_SIZE);
+
+	unsigned char* out = world.data();
+	size_t pos = 0;
+	memcpy(out, WORLD_MAGIC, sizeof(WORLD_MAGIC));
+	pos += sizeof(WORLD_MAGIC);
+	Put(out, pos, WORLD_VERSION);
+	Put(out, pos, tic);
+	Put(out, pos, GetIndex());
+	Put(out, pos, static_cast<unsigned int>(players.size()));
+	Put(out, pos, static_cast<unsigned int>(weapons.size()));
+	Put(out, pos, static_cast<unsigned int>(planes.size()));
+	Put(out, pos, static_cast<unsigned int>(things.size() - persistent));
+
+	PlayerState state;
+
+	for (unsigned int i = 0; i < players.size(); i++)
+	{
+		players[i]->Save(state);
+		Put(out, pos, state.pos);
+		Put(out, pos, state.mom);
+		Put(out, pos, PlaneIndex(state.plane, planes));
+		Put(out, pos, state.Angle);
+		Put(out, pos, state.VerticalAim);
+		Put(out, pos, state.MoX);
+		Put(out, pos, state.MoY);
+		Put(out, pos, state.MoZ);
+		Put(out, pos, state.AirTime);
+		Put(out, pos, state.ShouldFire);
+		Put(out, pos, state.TimeSinceLastShot);
+		Put(out, pos, state.OwnedWeapons);
+		Put(out, pos, state.Ammo);
+		Put(out, pos, state.Shells);
+		Put(out, pos, state.Rockets);
+		Put(out, pos, state.Cells);
+		Put(out, pos, state.Kills);
+		Put(out, pos, state.Deaths);
+	}
+
+	for (unsigned int i = persistent; i < things.size(); i++)
+	{
+		const Actor* thing = things[i];
+		ThingKind kind = thing->Kind();
+
+		Put(out, pos, kind);
+		Put(out, pos, thing->pos_);
+		Put(out, pos, thing->mom_);
+		Put(out, pos, PlaneIndex(thing->plane, planes));
+
+		switch (kind)
+		{
+			case KIND_PUFF:
+				Put(out, pos, static_cast<const Puff*>(thing)->Age_);
+				break;
+			case KIND_BLOOD:
+				Put(out, pos, static_cast<const Blood*>(thing)->Age_);
+				Put(out, pos, static_cast<const Blood*>(thing)->GroundZ_);
+				Put(out, pos, static_cast<const Blood*>(thing)->MomZ_);
+				break;
+			case KIND_PLASMA:
+				Put(out, pos, static_cast<const Plasma*>(thing)->Age_);
+				break;
+			default:
+				throw runtime_error("A persistent thing is after the temporary things");
+		}
+	}
+
+	world.resize(pos);
+}
+
+unsigned int Level::LoadWorld(const unsigned char* world, size_t size)
+{
+	if (size < sizeof(WORLD_MAGIC) || memcmp(world, WORLD_MAGIC, sizeof(WORLD_MAGIC)) != 0)
+		throw runtime_error("Not a world snapshot");
+
+	size_t pos = sizeof(WORLD_MAGIC);
+	unsigned int version, tic, numPlayers, numWeapons, numPlanes, numEffects;
+	unsigned short randIndex;
+
+	Get(world, size, pos, version);
+
+	if (version != WORLD_VERSION)
+		throw runtime_error("World snapshot has version " + to_string(version) + ", expected version " + to_string(WORLD_VERSION));
+
+	Get(world, size, pos, tic);
+	Get(world, size, pos, randIndex);
+	Get(world, size, pos, numPlayers);
+	Get(world, size, pos, numWeapons);
+	Get(world, size, pos, numPlanes);
+	Get(world, size, pos, numEffects);
+
+	if (numPlayers != players.size() || numWeapons != weapons.size() || numPlanes != planes.size())
+		throw runtime_error("World snapshot is from another level or has a different number of players");
+
+	PlayerState state;
+
+	for (unsigned int i = 0; i < players.size(); i++)
+	{
+		int plane;
+		Get(world, size, pos, state.pos);
+		Get(world, size, pos, state.mom);
+		Get(world, size, pos, plane);
+		state.plane = PlaneAt(plane, planes);
+		Get(world, size, pos, state.Angle);
+		Get(world, size, pos, state.VerticalAim);
+		Get(world, size, pos, state.MoX);
+		Get(world, size, pos, state.MoY);
+		Get(world, size, pos, state.MoZ);
+		Get(world, size, pos, state.AirTime);
+		Get(world, size, pos, state.ShouldFire);
+		Get(world, size, pos, state.TimeSinceLastShot);
+		Get(world, size, pos, state.OwnedWeapons);
+		Get(world, size, pos, state.Ammo);
+		Get(world, size, pos, state.Shells);
+		Get(world, size, pos, state.Rockets);
+		Get(world, size, pos, state.Cells);
+		Get(world, size, pos, state.Kills);
+		Get(world, size, pos, state.Deaths);
+		players[i]->Restore(state);
+	}
+
+	// Things of the same kind are overwritten in place. Creating a thing acquires its sprites from the cache.
+	unsigned int persistent = weapons.size() + players.size();
+
+	for (unsigned int i = 0; i < numEffects; i++)
+	{
+		ThingKind kind;
+		Float3 position, momentum;
+		int plane;
+		Get(world, size, pos, kind);
+		Get(world, size, pos, position);
+		Get(world, size, pos, momentum);
+		Get(world, size, pos, plane);
+
+		unsigned int index = persistent + i;
+		Actor* thing = index < things.size() ? things[index] : nullptr;
+
+		if (thing == nullptr || thing->Kind() != kind)
+		{
+			switch (kind)
+			{
+				case KIND_PUFF:
+					thing = new Puff(position.x, position.y, position.z);
+					break;
+				case KIND_BLOOD:
+					thing = new Blood(position.x, position.y, position.z, 0.0f);
+					break;
+				case KIND_PLASMA:
+					thing = new Plasma(position.x, position.y, position.z, momentum.x, momentum.y, momentum.z);
+					break;
+				default:
+					throw runtime_error("World snapshot has an unknown kind of thing");
+			}
+
+			if (index < things.size())
+			{
+				delete things[index];
+				things[index] = thing;
+			}
+			else
+			{
+				things.push_back(thing);
+			}
+		}
+
+		thing->pos_ = position;
+		thing->mom_ = momentum;
+		thing->plane = PlaneAt(plane, planes);
+
+		switch (kind)
+		{
+			case KIND_PUFF:
+				Get(world, size, pos, static_cast<Puff*>(thing)->Age_);
+				break;
+			case KIND_BLOOD:
+				Get(world, size, pos, static_cast<Blood*>(thing)->Age_);
+				Get(world, size, pos, static_cast<Blood*>(thing)->GroundZ_);
+				Get(world, size, pos, static_cast<Blood*>(thing)->MomZ_);
+				break;
+			case KIND_PLASMA:
+				Get(world, size, pos, static_cast<Plasma*>(thing)->Age_);
+				break;
+			default:
+				break;
+		}
+	}
+
+	for (unsigned int i = persistent + numEffects; i < things.size(); i++)
+	{
+		delete things[i];
+	}
+
+	things.resize(persistent + numEffects);
+	SetIndex(randIndex);
+
+	return tic;
+}
+
+string Level::DescribeWorld(const unsigned char* world, size_t size)
+{
+	if (size < sizeof(WORLD_MAGIC) || memcmp(world, WORLD_MAGIC, sizeof(WORLD_MAGIC)) != 0)
+		throw runtime_error("Not a world snapshot");
+
+	size_t pos = sizeof(WORLD_MAGIC);
+	unsigned int version, tic, numPlayers, numWeapons, numPlanes, numEffects;
+	unsigned short randIndex;
+
+	Get(world, size, pos, version);
+	Get(world, size, pos, tic);
+	Get(world, size, pos, randIndex);
+	Get(world, size, pos, numPlayers);
+	Get(world, size, pos, numWeapons);
+	Get(world, size, pos, numPlanes);
+	Get(world, size, pos, numEffects);
+
+	ostringstream text;
+	text << setprecision(9);	// Enough digits to tell every float apart
+
+	for (unsigned int i = 0; i < numPlayers; i++)
+	{
+		PlayerState state;
+		int plane;
+		Get(world, size, pos, state.pos);
+		Get(world, size, pos, state.mom);
+		Get(world, size, pos, plane);
+		Get(world, size, pos, state.Angle);
+		Get(world, size, pos, state.VerticalAim);
+		Get(world, size, pos, state.MoX);
+		Get(world, size, pos, state.MoY);
+		Get(world, size, pos, state.MoZ);
+		Get(world, size, pos, state.AirTime);
+		Get(world, size, pos, state.ShouldFire);
+		Get(world, size, pos, state.TimeSinceLastShot);
+		Get(world, size, pos, state.OwnedWeapons);
+		Get(world, size, pos, state.Ammo);
+		Get(world, size, pos, state.Shells);
+		Get(world, size, pos, state.Rockets);
+		Get(world, size, pos, state.Cells);
+		Get(world, size, pos, state.Kills);
+		Get(world, size, pos, state.Deaths);
+
+		text << "Player " << i + 1 << ": pos " << state.pos.x << ' ' << state.pos.y << ' ' << state.pos.z
+			<< " mom " << state.mom.x << ' ' << state.mom.y << ' ' << state.mom.z << " plane " << plane
+			<< " angle " << state.Angle << " aim " << state.VerticalAim << " move " << (int)state.MoX << ' ' << (int)state.MoY << ' ' << (int)state.MoZ
+			<< " airtime " << state.AirTime << " fire " << state.ShouldFire << " lastshot " << state.TimeSinceLastShot
+			<< " ammo " << state.Ammo << ' ' << state.Shells << ' ' << state.Rockets << ' ' << state.Cells
+			<< " kills " << state.Kills << " deaths " << state.Deaths << '\n';
+	}
+
+	text << numEffects << " effects\n";
+
+	for (unsigned int i = 0; i < numEffects; i++)
+	{
+		ThingKind kind;
+		Float3 position, momentum;
+		int plane, age;
+		Get(world, size, pos, kind);
+		Get(world, size, pos, position);
+		Get(world, size, pos, momentum);
+		Get(world, size, pos, plane);
+		Get(world, size, pos, age);
+
+		text << "Effect " << i << ": kind " << (int)kind << " pos " << position.x << ' ' << position.y << ' ' << position.z
+			<< " mom " << momentum.x << ' ' << momentum.y << ' ' << momentum.z << " plane " << plane << " age " << age;
+
+		if (kind == KIND_BLOOD)
+		{
+			float groundZ, momZ;
+			Get(world, size, pos, groundZ);
+			Get(world, size, pos, momZ);
+			text << " ground " << groundZ << " momz " << momZ;
+		}
+
+		text << '\n';
+	}
+
+	text << "Random index " << randIndex << '\n';
+
+	return text.str();
+}
+
+// FNV-1a. Floats are hashed by their bits, so the smallest difference is found.
+static void Hash(unsigned int& hash, const void* data, size_t size)
+{
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+
+	for (size_t i = 0; i < size; i++)
+	{
+		hash = (hash ^ bytes[i]) * 16777619;
+	}
+}
+
+static void Hash(unsigned int& hash, const Float3& v)
+{
+	float values[3] = {v.x, v.y, v.z};
+	Hash(hash, values, sizeof(values));
+}
+
+unsigned int Level::Checksum() const
+{
+	unsigned int hash = 2166136261;
+
+	for (unsigned int i = 0; i < players.size(); i++)
+	{
+		const Player* p = players[i];
+		Hash(hash, p->pos_);
+		Hash(hash, p->mom_);
+		Hash(hash, &p->Angle, sizeof(p->Angle));
+		Hash(hash, &p->VerticalAim, sizeof(p->VerticalAim));
+		Hash(hash, &p->AirTime, sizeof(p->AirTime));
+	}
+
+	unsigned int count = things.size();
+	Hash(hash, &count, sizeof(count));
+
+	for (unsigned int i = 0; i < things.size(); i++)
+	{
+		Hash(hash, things[i]->pos_);
+		Hash(hash, things[i]->mom_);
+	}
+
+	unsigned short index = GetIndex();
+	Hash(hash, &index, sizeof(index));
+
+	return hash;
+}
+
+string Level::DescribeState() const
+{
+	ostringstream text;
+	text << setprecision(9);	// Enough digits to tell every float apart
+
+	for (unsigned int i = 0; i < players.size(); i++)
+	{
+		const Player* p = players[i];
+		text << "Player " << i + 1 << ": pos " << p->pos_.x << ' ' << p->pos_.y << ' ' << p->pos_.z
+			<< " mom " << p->mom_.x << ' ' << p->mom_.y << ' ' << p->mom_.z << " angle " << p->Angle
+			<< " aim " << p->VerticalAim << " airtime " << p->AirTime << '\n';
+	}
+
+	text << things.size() << " things\n";
+
+	for (unsigned int i = 0; i < things.size(); i++)
+	{
+		text << "Thing " << i << ": pos " << things[i]->pos_.x << ' ' << things[i]->pos_.y << ' ' << things[i]->pos_.z
+			<< " mom " << things[i]->mom_.x << ' ' << things[i]->mom_.y << ' ' << things[i]->mom_.z << '\n';
+	}
+
+	text << "Random index " << GetIndex() << '\n';
+	text << "Checksum " << Checksum() << '\n';
+
+	return text.str();
+}
+
 void Level::SpawnPlayer(Player* play, const vector<Player*>& players)
 {
 	play->Reset();
@@ -113,6 +599,9 @@ void Level::SpawnPlayer(Player* play, const vector<Player*>& players)
 			play->pos_ = spawn.pos_;
 			play->Angle = spawn.Angle;
 		} while (PlayerToPlayersCollision(play, players));
+
+		// The player doesn't slide from where it was
+		play->Remember();
 	}
 	else
 	{
@@ -121,21 +610,120 @@ void Level::SpawnPlayer(Player* play, const vector<Player*>& players)
 	}
 }
 
-void Level::AddTexture(const string& name, bool enableFiltering)
+unsigned short Level::AddTexture(const string& name, bool enableFiltering)
 {
-	if (Cache::Instance()->Add(name, enableFiltering))
-	{
-		cout << "Added texture " << name << endl;
-	}
+	// A single reference is held for every plane that uses the texture
+	auto found = find(textures_.begin(), textures_.end(), name);
+
+	if (found != textures_.end())
+		return found - textures_.begin();
+
+	if (textures_.size() >= NO_TEXTURE)
+		throw runtime_error("Too many textures in level '" + levelname_ + "'");
+
+	// When streaming, the texture is loaded once it's needed
+	Cache::Instance()->Acquire(name, enableFiltering, !Cache::Instance()->Streaming());
+	textures_.push_back(name);
+	cout << "Added texture " << name << endl;
+
+	return textures_.size() - 1;
+}
+
+const string& Level::TextureName(unsigned short id) const
+{
+	return textures_.at(id);
+}
+
+unsigned int Level::AddVertex(const Float3& vertex, map<tuple<float, float, float>, unsigned int>& lookup)
+{
+	auto found = lookup.emplace(make_tuple(vertex.x, vertex.y, vertex.z), vertices.size());
+
+	if (found.second)
+		vertices.push_back(vertex);
+
+	return found.first->second;
+}
+
+unsigned int Level::AddUV(const Float2& uv, map<pair<float, float>, unsigned int>& lookup)
+{
+	auto found = lookup.emplace(make_pair(uv.x, uv.y), uvs.size());
+
+	if (found.second)
+		uvs.push_back(uv);
+
+	return found.first->second;
 }
 
 void Level::UseTexture(const string& name)
 {
 	// Avoid rebinding the texture if it's already binded
-	if (name != lastTextureBind)
+	if (name != lastTextureBind || lastPlaceholder_)
 	{
+		Texture* texture = Cache::Instance()->Streaming() ? Cache::Instance()->Peek(name) : Cache::Instance()->Get(name);
+
+		// Show something while the texture is streamed
+		lastPlaceholder_ = texture == nullptr;
+		if (lastPlaceholder_)
+			texture = Cache::Instance()->Placeholder(name);
+
 		lastTextureBind = name;
-		Cache::Instance()->Get(name)->Bind();
+		lastTextureId_ = NO_TEXTURE;
+		texture->Bind();
+	}
+}
+
+void Level::UseTexture(unsigned short id)
+{
+	// Comparing IDs is cheaper than comparing names
+	if (id != lastTextureId_ || lastPlaceholder_)
+	{
+		UseTexture(textures_[id]);
+		lastTextureId_ = id;
+	}
+}
+
+void Level::StreamTextures(float distance)
+{
+	// Conservative view cone. It's wider than the field of view so that textures are requested a bit early.
+	const float TAN_HALF_FOV = 2.0f;
+
+	Float3 cam = {play->CamX(), play->CamY(), play->CamZ()};
+	Float3 aim = {play->AimX(), play->AimY(), play->AimZ()};
+
+	for (unsigned int i = 0; i < unstreamed_.size(); )
+	{
+		const Plane* p = unstreamed_[i];
+		bool request = Cache::Instance()->Requested(textures_[p->Texture]);	// Another plane may have requested it
+
+		// Close to a player?
+		for (unsigned int j = 0; j < players.size() && !request; j++)
+		{
+			Float3 diff = subVectors(p->centroid, players[j]->pos_);
+			request = sqrt(dotProduct(diff, diff)) - p->Radius() <= distance;
+		}
+
+		// Inside the view cone?
+		if (!request)
+		{
+			Float3 diff = subVectors(p->centroid, cam);
+			float along = dotProduct(diff, aim);
+			float across = sqrt(max(dotProduct(diff, diff) - along * along, 0.0f));
+
+			request = along > -p->Radius() && across - p->Radius() <= (along + p->Radius()) * TAN_HALF_FOV;
+		}
+
+		if (request)
+		{
+			Cache::Instance()->Request(textures_[p->Texture]);
+
+			// The order of the list doesn't matter
+			unstreamed_[i] = unstreamed_.back();
+			unstreamed_.pop_back();
+		}
+		else
+		{
+			i++;
+		}
 	}
 }
 
@@ -151,6 +739,43 @@ void Level::LoadLevel(const string& LevelName, unsigned int numOfPlayers)
 	{
 		LoadNative(LevelName, numOfPlayers);
 	}
+
+	if (optimize_)
+	{
+		Optimize();
+	}
+
+	if (Cache::Instance()->Streaming())
+	{
+		unstreamed_.clear();
+
+		for (unsigned int i = 0; i < planes.size(); i++)
+		{
+			if (planes[i].Texture != NO_TEXTURE)
+				unstreamed_.push_back(&planes[i]);
+		}
+
+		// The sky is always visible
+		if (!SkyTexture.empty())
+			Cache::Instance()->Request(SkyTexture);
+	}
+}
+
+void Level::Optimize()
+{
+	unsigned int vertexCount = vertices.size();
+	unsigned int planeCount = planes.size();
+
+	auto start = chrono::steady_clock::now();
+	WeldVertices(vertices, planes);
+	auto welded = chrono::steady_clock::now();
+	MergePlanes(vertices, uvs, planes, useUVs_);
+	auto end = chrono::steady_clock::now();
+
+	cout << "Welded vertices: " << vertexCount << " -> " << vertices.size() << " in "
+		<< chrono::duration_cast<chrono::microseconds>(welded - start).count() << "us." << endl;
+	cout << "Merged planes: " << planeCount << " -> " << planes.size() << " in "
+		<< chrono::duration_cast<chrono::microseconds>(end - welded).count() << "us." << endl;
 }
 
 bool Level::HasUVs() const
@@ -161,10 +786,10 @@ bool Level::HasUVs() const
 // Loading method for native format
 void Level::LoadNative(const string& LevelName, unsigned int numOfPlayers)
 {
-	string FileName = LevelName;       // Added to make some compiler happy
-	ifstream LevelFile(FileName.c_str());
+	LumpStream LevelFile(LevelName);
 	if (LevelFile.is_open())
 	{
+		map<tuple<float, float, float>, unsigned int> lookup;	// Used to share the vertices between planes
 		bool blurTextures = false;
 		unsigned int Count = 0;
 		string Line;
@@ -207,12 +832,12 @@ void Level::LoadNative(const string& LevelName, unsigned int numOfPlayers)
 				}
 				else if (tokens[0] == "poly" && (tokens.size() == 21 || tokens.size() == 18))
 				{
-					Plane* p = new Plane();
-					p->Impassable = tokens[2][0] != '0';
-					p->TwoSided = tokens[3][0] != '0';
-					p->Xscale = atof(tokens[4].c_str());
-					p->Yscale = atof(tokens[5].c_str());
-					p->Light = atof(tokens[8].c_str());
+					Plane p;
+					p.Impassable = tokens[2][0] != '0';
+					p.TwoSided = tokens[3][0] != '0';
+					p.Xscale = atof(tokens[4].c_str());
+					p.Yscale = atof(tokens[5].c_str());
+					p.Light = atof(tokens[8].c_str());
 
 					// polygons are quads or triangles
 					for (unsigned int i = 9; i < tokens.size(); i += 3)
@@ -221,16 +846,15 @@ void Level::LoadNative(const string& LevelName, unsigned int numOfPlayers)
 						vt.x = atof(tokens[i].c_str());
 						vt.y = atof(tokens[i+1].c_str());
 						vt.z = atof(tokens[i+2].c_str());
-						p->Vertices.push_back(vt);
+						p.AddVertex(AddVertex(vt, lookup));
 					}
 
 					if (tokens[1] != "INVISIBLE")
 					{
-						AddTexture(tokens[1], blurTextures);	// Add texture to cache
-						p->Texture = tokens[1];
+						p.Texture = AddTexture(tokens[1], blurTextures);	// Add texture to cache
 					}
 
-					p->Process();
+					p.Process(vertices);
 					planes.push_back(p);
 				}
 				else if (tokens[0] == "setting" && tokens.size() == 3)
@@ -287,15 +911,17 @@ void Level::LoadObj(const string& path, unsigned int numOfPlayers)
 {
 	cout << "Loading 3D model: " << path << endl;
 
-	ifstream model;
+	LumpStream model;
 	model.open(path);
 
-	// Create temporary variables
-	vector<Float3> temp_vertices;
-	vector<Float2> temp_uvs;
-	vector<Float3> temp_normals;
+	// The OBJ's indices are translated to indices in the shared arrays without duplicates
+	map<tuple<float, float, float>, unsigned int> vertexLookup;
+	map<pair<float, float>, unsigned int> uvLookup;
+	vector<unsigned int> temp_vertices;
+	vector<unsigned int> temp_uvs;
 
 	string texture = "None";	// Current texture for plane
+	unsigned short textureId = NO_TEXTURE;
 	SkyTexture = "clouds.jpg";
 	AddTexture(SkyTexture, true);
 
@@ -321,62 +947,49 @@ void Level::LoadObj(const string& path, unsigned int numOfPlayers)
 					temp_vertex.x = atof(slices[3].c_str()) * scaling_;
 					temp_vertex.y = atof(slices[1].c_str()) * scaling_;
 					temp_vertex.z = atof(slices[2].c_str()) * scaling_;
-					temp_vertices.push_back(temp_vertex);
+					temp_vertices.push_back(AddVertex(temp_vertex, vertexLookup));
 				}
 				else if (slices[0] == "vt" && slices.size() == 3)	// Texture coordinate of a vertex
 				{
 					Float2 temp_uv;
 					temp_uv.x = atof(slices[1].c_str());
 					temp_uv.y = atof(slices[2].c_str());
-					temp_uvs.push_back(temp_uv);
+					temp_uvs.push_back(AddUV(temp_uv, uvLookup));
 				}
 				else if (slices[0] == "vn" && slices.size() == 4)	// Normal of a vertex
 				{
-					Float3 temp_normal;
-					temp_normal.x = atof(slices[1].c_str());
-					temp_normal.y = atof(slices[2].c_str());
-					temp_normal.z = atof(slices[3].c_str());
-					temp_normals.push_back(temp_normal);
+					// Ignored. The normal of a plane is computed from its vertices.
 				}
 				else if (slices[0] == "f" && (slices.size() == 4 || slices.size() == 5))	// Defines a face
 				{
+					// Polygons that don't have a texture are skipped
+					if (texture == "None")
+						continue;
+
 					// Create a plane for a set of vertices
-					Plane* p = new Plane();
-					p->Impassable = 1;
-					p->TwoSided = 0;
-					p->Xscale = 1;
-					p->Yscale = 1;
-					p->Light = 1;
-
-					// Assign the last specified texture if the plane is not invisible
-					if (texture != "None")
-					{
-						p->Texture = texture;
-					}
+					Plane p;
+					p.Impassable = 1;
+					p.TwoSided = 0;
+					p.Xscale = 1;
+					p.Yscale = 1;
+					p.Light = 1;
+					p.Texture = textureId;
 
 					// Format: vertex, uv, normal. They are indices that points to the previous data.
 					for (unsigned int i = 1; i < slices.size(); i++)
 					{
 						vector<string> indices = Split(slices[i], '/');
+						unsigned int uv = 0;
 
-						if (indices.size() >= 1)
+						if (indices.size() >= 2 && !indices[1].empty())
 						{
-							vertices_.push_back(temp_vertices[atoi(indices[0].c_str())-1]);
-							p->Vertices.push_back(temp_vertices[atoi(indices[0].c_str())-1]);
+							uv = temp_uvs.at(atoi(indices[1].c_str())-1);
 						}
 
-						if (indices.size() >= 2)
-						{
-							uvs_.push_back(temp_uvs[atoi(indices[1].c_str())-1]);
-
-							if (indices.size() == 3)
-							{
-								normals_.push_back(temp_normals[atoi(indices[2].c_str())-1]);
-							}
-						}
+						p.AddVertex(temp_vertices.at(atoi(indices[0].c_str())-1), uv);
 					}
 
-					p->Process();
+					p.Process(vertices);
 					planes.push_back(p);
 				}
 				else if (slices[0] == "usemtl" && slices.size() == 2)
@@ -389,7 +1002,7 @@ void Level::LoadObj(const string& path, unsigned int numOfPlayers)
 
 					if (!EndsWith(texture, "None"))
 					{
-						AddTexture(texture, false);
+						textureId = AddTexture(texture, false);
 					}
 					else	// Texture is "None"
 					{
@@ -453,33 +1066,11 @@ void Level::LoadObj(const string& path, unsigned int numOfPlayers)
 		things.insert(things.end(), weapons.begin(), weapons.end());
 		things.insert(things.end(), players.begin(), players.end());
 
-		if (uvs_.empty())
-		{
-			// This should help diagnostics
-			cerr << "WARNING: No UVs found. The program is expected to crash." << endl;
-		}
-
-		// Set UVs
-		unsigned int uv_count = 0;
-		for (unsigned int i = 0; i < planes.size(); i++)
-		{
-			for (unsigned int j = 0; j < planes[i]->Vertices.size(); j++)
-			{
-				// Distribute an UV to each vertice
-				planes[i]->UVs.push_back(uvs_[uv_count]);
-
-				uv_count++;
-			}
-		}
-
-		// Remove polygons that don't have a texture
-		for (int i = planes.size() - 1; i >= 0; i--)
+		if (uvs.empty())
 		{
-			if (planes[i]->Texture == "")
-			{
-				delete planes[i];
-				planes.erase(planes.begin() + i);
-			}
+			// Every plane points to the first UV. This should help diagnostics.
+			cerr << "WARNING: No UVs found. Textures will not be mapped." << endl;
+			uvs.push_back({0, 0});
 		}
 	}
 	else
@@ -490,21 +1081,21 @@ void Level::LoadObj(const string& path, unsigned int numOfPlayers)
 	model.close();
 }
 
-vector<Plane*> Level::getPlanesForBox(float x, float y, float radius) const
+vector<const Plane*> Level::getPlanesForBox(float x, float y, float radius) const
 {
 	// TODO: Should be computed once. Doesn't need to be computed again unless map
 	// geometry moves. Planes could be linked together like a linked list. We could
 	// keep track of the plane where the player is located to speed up lookups.
 	// This would also be useful for the bot's pathfinding.
 
-	vector<Plane*> boxplanes;
+	vector<const Plane*> boxplanes;
 
 	for (unsigned int k = 0; k < planes.size(); k++)
 	{
 		// Check if the player could be in the box (2D check)
-		if (planes[k]->InBox2D(x, y, radius))
+		if (planes[k].InBox2D(x, y, radius))
 		{
-			boxplanes.push_back(planes[k]);
+			boxplanes.push_back(&planes[k]);
 		}
 	}
 
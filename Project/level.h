@@ -27,8 +27,18 @@
 
 #include <vector>
 #include <string>
+#include <map>
+#include <tuple>
+#include <utility>	/* pair */
 using namespace std;
 
+// World snapshots are in the byte order of the computer that made them.
+//   Header:  "MGWS", version, tic, random index, number of players, weapons, planes and temporary things
+//   Players: the state of each player
+//   Things:  kind, then the state of each temporary thing
+const char WORLD_MAGIC[4] = {'M', 'G', 'W', 'S'};
+const unsigned int WORLD_VERSION = 1;
+
 class Level
 {
 public:
@@ -36,17 +46,21 @@ public:
 	string SkyTexture;
 
 	// Stuff that's part of the map
-	vector<Plane*> planes;
+	vector<Plane> planes;	// Stored contiguously. Don't add planes once the level is loaded.
+	vector<Float3> vertices;	// Shared by the planes, without duplicates
+	vector<Float2> uvs;	// Shared by the planes, without duplicates
 	Player* play = nullptr;	// Pointer to the current player
 	vector<Player*> players;	// Pointers to every player
 	vector<SpawnSpot> spawns;
 	vector<Weapon*> weapons;
 	vector<Actor*> things;	// In order to draw everything easily, everything is put in the same array. TODO: Use a deque?
 
-	void AddTexture(const string& name, bool enableFiltering);	// Add texture to cache if missing
+	unsigned short AddTexture(const string& name, bool enableFiltering);	// Add texture to cache if missing and hold a reference. Returns its ID.
+	const string& TextureName(unsigned short id) const;
 	void UseTexture(const string& name);	// Bind texture
+	void UseTexture(unsigned short id);
 
-	Level(const string& level, float scaling, unsigned int numOfPlayers);
+	Level(const string& level, float scaling, unsigned int numOfPlayers, bool optimize = true);
 	~Level();
 	void Reload();	// Reload level geometry
 
@@ -56,22 +70,42 @@ public:
 
 	void SpawnPlayer(Player* play, const vector<Player*>& players);
 	void UpdateThings();
+	void RunTic();	// Moves the players using their commands, then updates the things
+
+	// Everything that changes while the game runs, in a single buffer. It's used to go back to a previous tic, and
+	// it can be written to a file or sent to another player. The geometry is not part of it, so the level must be
+	// loaded the same way before reading it back. 'world' is reused.
+	void SaveWorld(vector<unsigned char>& world, unsigned int tic) const;
+	unsigned int LoadWorld(const unsigned char* world, size_t size);	// Returns the tic. Throws if it's from another level.
+	static string DescribeWorld(const unsigned char* world, size_t size);	// The snapshot in text form, to find what's different after a desync
+
+	// Hash of the players, the things and the random numbers. Games that are in sync have the same checksum.
+	unsigned int Checksum() const;
+	string DescribeState() const;	// What the checksum covers, in text form, to find what's different after a desync
+
+	// Request the textures of planes that are visible or within 'distance' of a player (streaming mode)
+	void StreamTextures(float distance);
 
 	bool HasUVs() const;
 
-	vector<Plane*> getPlanesForBox(float x, float y, float radius) const;
+	vector<const Plane*> getPlanesForBox(float x, float y, float radius) const;
 
 private:
-	// OBJ and OpenGL stuff
-	vector<Float3> vertices_;
-	vector<Float2> uvs_;
-	vector<Float3> normals_;
+	vector<string> textures_;	// Textures referenced by the level. A plane's texture ID is an index in this table.
 
 	float scaling_ = 1.0f;	// Level scaling that adjusts the size of the level proportionally
+	bool optimize_ = true;	// Weld vertices and merge planes when the level is loaded
 	string levelname_;
 	string lastTextureBind = "";
+	unsigned short lastTextureId_ = NO_TEXTURE;
+	bool lastPlaceholder_ = false;	// The placeholder was bound instead of 'lastTextureBind'
+	vector<const Plane*> unstreamed_;	// Planes whose texture was not requested yet
 	bool reloaded_ = false;
 	void BuildBlockmap();
+	void Optimize();
+	void ReleaseTextures(vector<string>& textures);
+	unsigned int AddVertex(const Float3& vertex, map<tuple<float, float, float>, unsigned int>& lookup);
+	unsigned int AddUV(const Float2& uv, map<pair<float, float>, unsigned int>& lookup);
 	bool useUVs_ = false;
 };
 
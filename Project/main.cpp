@@ -17,6 +17,10 @@
 // Call the function that contains the main loop. Catch any exceptions.
 
 #include "mainloop.h"
+#include "botclient.h"
+#include "snapbench.h"
+#include "replay.h"
+#include "command.h"	/* FindArgumentPosition */
 
 #include <SDL2/SDL.h>		/* SDL_ShowSimpleMessageBox */
 
@@ -30,6 +34,20 @@ int main(int argc, const char* argv[])
 {
 	try
 	{
+		// Headless clients for load testing
+		if (FindArgumentPosition(argc, argv, "-swarm") > 0)
+			return swarm(argc, argv);
+
+		if (FindArgumentPosition(argc, argv, "-botclient") > 0)
+			return botclient(argc, argv);
+
+		// Plays a list of demos without a window
+		if (FindArgumentPosition(argc, argv, "-replay") > 0)
+			return replay(argc, argv);
+
+		if (FindArgumentPosition(argc, argv, "-snapbench") > 0)
+			return snapbench(argc, argv);
+
 		return mainloop(argc, argv);
 	}
 	catch (const exception& e)
@@ -25,9 +25,15 @@
 #include "physics.h"
 #include "random.h"		/* GetIndex, SetIndex, Seed */
 #include "events.h"
+#include "demo.h"
 #include "network.h"
+#include "netgame.h"
+#include "netsim.h"
 #include "strutils.h"	/* Split */
 #include "bot.h"
+#include "archive.h"	/* Resources, LumpStream */
+#include "cache.h"		/* Cache */
+#include "pacer.h"		/* Pacer */
 
 #include <GLFW/glfw3.h>
 #include <GL/gl.h>
@@ -42,23 +48,41 @@
 
 using namespace std;
 
+const unsigned int TICRATE = 60;	// Tics per second
+const unsigned int MAX_CATCHUP = 15;	// Most tics that are run before drawing a frame
+
 int mainloop(int argc, const char* argv[])
 {
 	const char* const VERSION = "0.58 (dev)";
 
 	bool Quit = false;
-	static unsigned int TicCount = 0;
+	unsigned int TicCount = 0;
+	unsigned int ConfirmedTic = 0;	// Rollback mode. Every tic before it was shown and recorded.
 	bool Debug = false;
-	ofstream DemoWrite;
-	ifstream DemoRead;
+	DemoWriter DemoWrite;
+	DemoReader DemoRead;
+	vector<unsigned char> World;	// Keyframes of the demo that's recorded
+	ofstream ChatWrite;	// Chat messages of the demo. The file is created when there's a message.
+	LumpStream ChatRead;
+	ChatMessage DemoChat;	// Next chat message of the demo that's played
+	bool HasDemoChat = false;
+	unsigned int DemoSum = 0;	// Checksum of the demo that's played
+	unsigned int DemoMatched = 0;	// Every tic before it had the checksums of the demo
+	bool DemoDesynced = false;
+	unsigned int SummedTic = 0;	// Rollback mode. Every tic before it had its checksum recorded.
 	unsigned int FrameDelay = 0;
 	string LevelName = "test.txt";
+	bool Optimize = FindArgumentPosition(argc, argv, "-nooptimize") == 0;	// Weld and merge the level's geometry. Everyone must do the same.
 	bool Fast = false;	// To unlock the speed of the game
-	auto GameStartTime = chrono::system_clock::now();
+	bool Headless = false;	// Only the simulation runs. There's no window and no OpenGL.
+	unsigned int MaxTics = 0;	// 0 plays until a player quits
+	auto GameStartTime = chrono::steady_clock::now();
 	extern GameWindow view;
 	Network network;
+	NetSim* netsim = nullptr;
+	NetGame* netgame = nullptr;
 	int numOfPlayers = 1;
-	int frameSkip = 0;
+	Pacer FramePacer(TICRATE);	// The screen is drawn at the rate of the game by default
 
 	cout << "                MESHGLIDE ENGINE -- " << VERSION << "\n\n";
 
@@ -76,10 +100,68 @@ int mainloop(int argc, const char* argv[])
 		Fast = true;
 	}
 
-	if (FindArgumentPosition(argc, argv, "-frameskip") > 0)
+	if (FindArgumentPosition(argc, argv, "-headless") > 0)
+	{
+		// For dedicated hosts and benchmarks on computers without a display. The textures are never uploaded.
+		Headless = true;
+		Cache::Instance()->SetHeadless();
+		cout << "Headless mode ON." << endl;
+	}
+
+	if (FindArgumentPosition(argc, argv, "-tics") > 0)
+	{
+		// The game ends by itself after that many tics, as if the player quit
+		MaxTics = stoul(FindArgumentParameter(argc, argv, "-tics", "0"));
+	}
+
+	if (FindArgumentPosition(argc, argv, "-maxfps") > 0)
+	{
+		// The game always runs at the same speed, but the screen is drawn at this rate. It can have decimals, like 59.94. 0 is no limit.
+		FramePacer.SetRate(stod(FindArgumentParameter(argc, argv, "-maxfps", "0")));
+	}
+	else if (FindArgumentPosition(argc, argv, "-vsync") > 0)
+	{
+		// The screen's refresh rate is the limit
+		FramePacer.SetRate(0);
+	}
+
+	if (FindArgumentPosition(argc, argv, "-pacelog") > 0)
 	{
-		// How many frames to skip before drawing one.
-		frameSkip = stoi(FindArgumentParameter(argc, argv, "-frameskip"));
+		// Time between the frames, to check the jitter
+		FramePacer.SetLog(FindArgumentParameter(argc, argv, "-pacelog", "pacing.log"));
+	}
+
+	if (FindArgumentPosition(argc, argv, "-texbudget") > 0)
+	{
+		// Memory budget for the textures in MB. Textures that are not used are evicted above it.
+		Cache::Instance()->SetBudget(stoul(FindArgumentParameter(argc, argv, "-texbudget")) * 1024 * 1024);
+	}
+
+	// Load textures lazily in the background when they get close or visible
+	float StreamDistance = 0;
+	if (FindArgumentPosition(argc, argv, "-stream") > 0)
+	{
+		StreamDistance = stof(FindArgumentParameter(argc, argv, "-stream", "64"));
+
+		// Amount of texture data uploaded per frame in KB
+		size_t UploadBudget = stoul(FindArgumentParameter(argc, argv, "-streambudget", "512"));
+		Cache::Instance()->SetStreaming(UploadBudget * 1024);
+	}
+
+	/****************************** RESOURCES ******************************/
+
+	// Assets can be packed in an archive. Loose files still have priority over it.
+	string ArchiveName = FindArgumentParameter(argc, argv, "-archive");
+	if (!ArchiveName.empty())
+	{
+		if (!Resources::Instance()->Mount(ArchiveName))
+		{
+			throw runtime_error("Could not open archive '" + ArchiveName + "'");
+		}
+	}
+	else
+	{
+		Resources::Instance()->Mount("meshglide.mgpk");
 	}
 
 	/****************************** DEMO FILES ******************************/
@@ -88,11 +170,11 @@ int mainloop(int argc, const char* argv[])
 	if (!DemoName.empty())
 	{
 		cout << "Playing demo: " << DemoName << endl;
-		DemoRead.open(DemoName);
-		if (!DemoRead.is_open())
-		{
-			throw runtime_error("Could not open demo '" + DemoName + "'");
-		}
+		DemoRead.Open(DemoName);
+
+		// The chat is optional
+		ChatRead.open(DemoName + ".chat");
+		HasDemoChat = ChatRead.is_open() && readChatFromDemo(ChatRead, DemoChat);
 	}
 	else
 	{
@@ -102,35 +184,28 @@ int mainloop(int argc, const char* argv[])
 		DemoName = FindArgumentParameter(argc, argv, "-record");
 		if (!DemoName.empty())
 		{
+			// The demo is created once the level is loaded
 			cout << "Recoring demo: " << DemoName << endl;
-			DemoWrite.open(DemoName);
-			if (!DemoWrite.is_open())
-			{
-				throw runtime_error("Could not open file '" + DemoName + "' to write");
-			}
 		}
 	}
 
-	if (DemoRead.is_open())
+	if (DemoRead.IsOpen())
 	{
-		string line;
-		getline(DemoRead, line);
-		cout << "Demo Version: " << line << endl;
+		cout << "Demo Version: " << DemoRead.Version() << " (format " << DemoRead.Format() << ")" << endl;
 
-		if (string(VERSION) != line)
+		if (string(VERSION) != DemoRead.Version())
 		{
 			cout << "Demo is from a different version. A desync may occur." << endl;
 		}
 
-		getline(DemoRead, line);
-		LevelName = line;
-		cout << "Level name: " << line << endl;
-		getline(DemoRead, line);
-		SetIndex(stoi(line));		// Randomization
-		cout << "Seed: " << line << endl;
-		getline(DemoRead, line);
-		numOfPlayers = stoi(line);
-		cout << "# of players: " << line << endl;
+		LevelName = DemoRead.Level();
+		cout << "Level name: " << LevelName << endl;
+		SetIndex(DemoRead.Seed());		// Randomization
+		cout << "Seed: " << DemoRead.Seed() << endl;
+		numOfPlayers = DemoRead.Players();
+		cout << "# of players: " << numOfPlayers << endl;
+		Optimize = DemoRead.Optimized();	// Merged planes collide differently
+		cout << "Optimized level: " << (Optimize ? "yes" : "no") << endl;
 	}
 	else
 	{
@@ -164,7 +239,7 @@ int mainloop(int argc, const char* argv[])
 
 	/****************************** NETWORKING ******************************/
 
-	if (!DemoRead.is_open())
+	if (!DemoRead.IsOpen())
 	{
 		string hostport;
 		if (FindArgumentPosition(argc, argv, "-host") > 0)
@@ -174,12 +249,27 @@ int mainloop(int argc, const char* argv[])
 		if (FindArgumentPosition(argc, argv, "-connect") > 0)
 			serverloc = FindArgumentParameter(argc, argv, "-connect", "localhost:5555");
 
+		// Predict the other players instead of waiting for them. There's no input delay by default.
+		unsigned int rollbackWindow = 0;
+		if (FindArgumentPosition(argc, argv, "-rollback") > 0)
+			rollbackWindow = stoul(FindArgumentParameter(argc, argv, "-rollback", to_string(DEFAULT_ROLLBACK_WINDOW)));
+
+		// Number of tics between the moment a command is sampled and the moment it's executed
+		unsigned int inputDelay = stoul(FindArgumentParameter(argc, argv, "-inputdelay", rollbackWindow > 0 ? "0" : to_string(DEFAULT_INPUT_DELAY)));
+
 		if (!hostport.empty())
 		{
-			numOfPlayers = 2;	// (for now, it's always two players)
+			// The server is a player too
+			numOfPlayers = stoi(FindArgumentParameter(argc, argv, "-players", "2"));
+
+			if (numOfPlayers < 2 || numOfPlayers > (int)MAXPLAYERS)
+			{
+				throw runtime_error("The number of players must be between 2 and " + to_string(MAXPLAYERS));
+			}
+
 			// Start a server
-			string info = LevelName + '\n' + to_string(initialIndex) + '\n' + to_string(numOfPlayers);
-			network.startServer(hostport, info);
+			string info = LevelName + '\n' + to_string(initialIndex) + '\n' + to_string(numOfPlayers) + '\n' + to_string(inputDelay) + '\n' + to_string(rollbackWindow) + '\n' + to_string(Optimize);
+			network.startServer(hostport, info, numOfPlayers - 1);
 		}
 		else if (!serverloc.empty())
 		{
@@ -190,28 +280,59 @@ int mainloop(int argc, const char* argv[])
 			LevelName = infos[0];
 			SetIndex(initialIndex = stoi(infos[1]));
 			numOfPlayers = stoi(infos[2]);
+			inputDelay = stoul(infos[3]);	// Everyone must use the same delay
+			rollbackWindow = stoul(infos[4]);
+			Optimize = infos.size() > 5 && infos[5] == "1";	// The level must have the same planes to collide the same way
 		}
-	}
 
-	/****************************** OPENGL HANDLING ******************************/
+		if (network.enabled())
+		{
+			Transport* transport = &network;
 
-	// Load OpenGL
-	GLFWwindow* window = Init_OpenGL(FindArgumentPosition(argc, argv, "-fullscreen") > 0, "MeshGlide v" + string(VERSION));
+			// Latency, jitter, loss, reordering and bandwidth for testing on a single computer
+			if (FindArgumentPosition(argc, argv, "-netsim") > 0)
+			{
+				netsim = new NetSim(network, NetConditions::Parse(FindArgumentParameter(argc, argv, "-netsim", "100,20,2,1,0")));
+				transport = netsim;
+			}
 
-	if (!window)
+			netgame = new NetGame(*transport, numOfPlayers, inputDelay, rollbackWindow);
+
+			if (FindArgumentPosition(argc, argv, "-netlog") > 0)
+				netgame->SetLog(FindArgumentParameter(argc, argv, "-netlog", "netgame.log"));
+		}
+	}
+
+	// Without a window, nothing else would end the game
+	if (Headless && !DemoRead.IsOpen() && !netgame && MaxTics == 0)
 	{
-		throw runtime_error("Could not create OpenGL window!");
+		throw runtime_error("-headless needs -playdemo, a network game or -tics");
 	}
 
-	if (FindArgumentPosition(argc, argv, "-wireframe") > 0)
+	/****************************** OPENGL HANDLING ******************************/
+
+	GLFWwindow* window = nullptr;
+
+	// Load OpenGL
+	if (!Headless)
 	{
-		cout << "_OpenGL: Wireframe mode activated." << endl;
-		glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+		window = Init_OpenGL(FindArgumentPosition(argc, argv, "-fullscreen") > 0, "MeshGlide v" + string(VERSION), FindArgumentPosition(argc, argv, "-vsync") > 0);
+
+		if (!window)
+		{
+			throw runtime_error("Could not create OpenGL window!");
+		}
+
+		if (FindArgumentPosition(argc, argv, "-wireframe") > 0)
+		{
+			cout << "_OpenGL: Wireframe mode activated." << endl;
+			glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+		}
 	}
 
 	/****************************** LEVEL LOADING ******************************/
 
-	Level* CurrentLevel = new Level(LevelName, stof(FindArgumentParameter(argc, argv, "-scale", "1.0")), numOfPlayers);	// Holds the level's data
+	Level* CurrentLevel = new Level(LevelName, stof(FindArgumentParameter(argc, argv, "-scale", "1.0")), numOfPlayers, Optimize);	// Holds the level's data
 
 	if (!CurrentLevel || CurrentLevel->planes.size() == 0)
 	{
@@ -223,231 +344,326 @@ int mainloop(int argc, const char* argv[])
 	CurrentLevel->play = CurrentLevel->players[network.myPlayer()];
 	CurrentLevel->play->Cmd.id = network.myPlayer();
 
-	if (DemoWrite.is_open())
+	if (!DemoName.empty() && !DemoRead.IsOpen())
 	{
-		DemoWrite << VERSION << endl;
-		DemoWrite << LevelName << endl;
-		DemoWrite << initialIndex << endl;
-		DemoWrite << CurrentLevel->players.size() << endl;
+		DemoWrite.Open(DemoName, VERSION, LevelName, initialIndex, CurrentLevel->players.size(), Optimize);
+	}
+
+	// Start a demo in the middle. The game goes back to the last keyframe before that tic, then runs the tics that are left.
+	if (DemoRead.IsOpen() && FindArgumentPosition(argc, argv, "-warp") > 0)
+	{
+		unsigned int WarpTic = stoul(FindArgumentParameter(argc, argv, "-warp", "0"));
+		const unsigned char* world;
+		size_t size;
+
+		TicCount = DemoRead.Seek(WarpTic, world, size);
+
+		if (world && CurrentLevel->LoadWorld(world, size) != TicCount)
+		{
+			throw runtime_error("Demo has a keyframe that is not at the right tic");
+		}
+
+		cout << "Warping to tic " << WarpTic << " from the keyframe at tic " << TicCount << "." << endl;
+
+		while (TicCount < WarpTic && DemoRead.Read(CurrentLevel->players))
+		{
+			CurrentLevel->RunTic();
+			TicCount++;
+		}
+
+		// The messages of the tics that were skipped are not shown
+		while (HasDemoChat && DemoChat.tic < TicCount)
+		{
+			HasDemoChat = readChatFromDemo(ChatRead, DemoChat);
+		}
 	}
 
 	/****************************** GAME LOOP ******************************/
+
+	// The game runs at a fixed rate. The screen is drawn as often as possible, between the last two tics.
+	const chrono::nanoseconds TicTime(1000000000 / TICRATE);
+	chrono::nanoseconds Lag = TicTime;	// Time that was not simulated yet. The first tic runs right away.
+	auto Previous = chrono::steady_clock::now();
+
+	// When benchmarking or without a screen, the frames are only measured. A host without a
+	// screen still runs at the rate of the game, or it would run ahead of the other players.
+	bool Unpaced = Fast || (Headless && !netgame);
+
+	if (Unpaced)
+		FramePacer.SetRate(0);
+	else if (Headless)
+		FramePacer.SetRate(TICRATE);
+
 	do
 	{
 		// Timer
-		auto start = chrono::system_clock::now();
+		auto start = chrono::steady_clock::now();
+		Lag += start - Previous;
+		Previous = start;
+
+		// After a long stall, the game slows down instead of running every tic that was missed at once
+		if (Lag > TicTime * MAX_CATCHUP)
+			Lag = TicTime * MAX_CATCHUP;
+
+		// When benchmarking or without a screen, a tic is run on each frame, as fast as possible
+		if (Unpaced)
+			Lag = TicTime;
 
-		glfwPollEvents();
-		if (!FindArgumentPosition(argc, argv, "-poolonce"))
+		if (!Headless)
+		{
 			glfwPollEvents();
-		RegisterKeyPresses(window);
+			if (!FindArgumentPosition(argc, argv, "-poolonce"))
+				glfwPollEvents();
+			RegisterKeyPresses(window);
+		}
 
-		if (DemoRead.is_open())
+		// Run the tics that are due. The events of the frame are used for each of them.
+		while (!Quit && Lag >= TicTime)
 		{
-			// Read demo. No event capture or network activity occurs.
-			Quit = !readCmdFromDemo(DemoRead, CurrentLevel->players);
+			Lag -= TicTime;
 
-			if (glfwWindowShouldClose(window))
+			if (DemoRead.IsOpen())
 			{
-				Quit = true;
+				// Read demo. No event capture or network activity occurs. The game ends before a tic without commands runs.
+				if ((MaxTics > 0 && TicCount >= MaxTics) || !DemoRead.Read(CurrentLevel->players))
+				{
+					Quit = true;
+					break;
+				}
+
+				while (HasDemoChat && DemoChat.tic <= TicCount)
+				{
+					ShowMessage(view, DemoChat.text);
+					HasDemoChat = readChatFromDemo(ChatRead, DemoChat);
+				}
+
+				if (!Headless && glfwWindowShouldClose(window))
+				{
+					Quit = true;
+				}
 			}
-		}
-		else
-		{
-			// Events can only be captured if the player is not in chat mode
-			if (!view.chatMode)
+			else
 			{
-				updatePlayerWithEvents(window, view, TicCount, CurrentLevel->play);
-			}
+				// Events can only be captured if the player is not in chat mode. Without a window, the commands stay empty.
+				if (!Headless && !view.chatMode)
+				{
+					updatePlayerWithEvents(window, view, TicCount, CurrentLevel->play);
+				}
 
-			// Run bot on Player 2. For testing.
-//			updateBot(CurrentLevel->players[1], CurrentLevel);
+				// Run bot on Player 2. For testing.
+//				updateBot(CurrentLevel->players[1], CurrentLevel);
 
-			// Cause the game to quit if the player wants to
-			if (glfwWindowShouldClose(window))
-			{
-				CurrentLevel->play->Cmd.quit = true;
-			}
+				// Cause the game to quit if the player wants to
+				if ((!Headless && glfwWindowShouldClose(window)) || (MaxTics > 0 && TicCount + 1 >= MaxTics))
+				{
+					CurrentLevel->play->Cmd.quit = true;
+				}
 
-			// Send commands over network and receive commands
-			if (network.enabled())
-			{
-				if (network.myPlayer() == 0)
+				// Send commands over network and receive commands
+				if (netgame)
 				{
+					Player* me = CurrentLevel->players[network.myPlayer()];
+
 					if (view.chatSend)
 					{
-						CurrentLevel->players[0]->Cmd.chat = view.chatStr;
+						netgame->Chat(view.chatStr);
 						view.chatSend = false;
 						view.chatStr.clear();
 					}
 
-					// Receive network event from player 2
-					CurrentLevel->players[1]->NetToCmd(network.receive());
+					// The command is sent now and executed after the input delay
+					netgame->Submit(me->Cmd);
 
-					// Send network event to player 2
-					network.send(CurrentLevel->players[0]->CmdToNet());
-
-					if (CurrentLevel->players[1]->Cmd.chat.size() > 0)
+					// Wait until the tic can be run. The window is still drawn and the events are still handled.
+					const int WAIT_DELAY = 16;	// ms
+					while (!Quit && !netgame->TryWait(TicCount))
 					{
-						ShowMessage(view, CurrentLevel->players[1]->Cmd.chat);
-					}
+						if (Headless)
+						{
+							// Sleep until a message arrives
+							netgame->Poll(WAIT_DELAY);
+							continue;
+						}
 
-				}
-				else if (network.myPlayer() == 1)
-				{
-					if (view.chatSend)
-					{
-						CurrentLevel->players[1]->Cmd.chat = view.chatStr;
-						view.chatSend = false;
-						view.chatStr.clear();
+						view.status = "Waiting for player " + to_string(netgame->Missing() + 1);
+						DrawScreen(window, CurrentLevel->play, CurrentLevel, FrameDelay);
+						SDL_Delay(WAIT_DELAY);
+
+						glfwPollEvents();
+						RegisterKeyPresses(window);
+
+						// The other players will time out
+						if (glfwWindowShouldClose(window))
+							Quit = true;
 					}
 
-					// Send network event to player 1
-					network.send(CurrentLevel->players[1]->CmdToNet());
+					view.status.clear();
 
-					// Receive network event from player 1
-					CurrentLevel->players[0]->NetToCmd(network.receive());
+					if (Quit)
+						break;
 
-					if (CurrentLevel->players[0]->Cmd.chat.size() > 0)
+					if (!netgame->Rollback())
+						netgame->Load(TicCount, CurrentLevel->players);
+
+					// Show the chat messages once their tic is reached
+					ChatMessage chat;
+					while (netgame->NextChat(TicCount, chat))
 					{
-						ShowMessage(view, CurrentLevel->players[0]->Cmd.chat);
+						if (chat.player != network.myPlayer())
+							ShowMessage(view, chat.text);
+
+						if (DemoWrite.IsOpen())
+						{
+							if (!ChatWrite.is_open())
+								ChatWrite.open(DemoName + ".chat");
+
+							writeChatToDemo(ChatWrite, chat);
+						}
 					}
 				}
 				else
 				{
-					throw runtime_error("Something is wrong: Player ID is not 0 or 1.");
+					// Cleanup the chat strings when in single player mode
+					if (view.chatSend)
+					{
+						view.chatSend = false;
+						view.chatStr.clear();
+					}
 				}
-			}
-			else
-			{
-				// Cleanup the chat strings when in single player mode
-				if (view.chatSend)
+
+				// Write commands to demo. With rollback, it's done once the commands are confirmed.
+				if (DemoWrite.IsOpen() && !(netgame && netgame->Rollback()))
 				{
-					view.chatSend = false;
-					view.chatStr.clear();
+					// The state before this tic, so that the demo can start here
+					if (DemoWrite.NeedsKeyframe())
+					{
+						CurrentLevel->SaveWorld(World, TicCount);
+						DemoWrite.Keyframe(World);
+					}
+
+					DemoWrite.Write(CurrentLevel->players);
 				}
 			}
 
-			// Write commands to demo
-			if (DemoWrite.is_open())
-			{
-				writeCmdToDemo(DemoWrite, CurrentLevel->players);
-			}
-		}
+			updateSpecials(CurrentLevel->play, CurrentLevel->players);
 
-		updateSpecials(CurrentLevel->play, CurrentLevel->players);
-
-		// Update game logic
-		for (unsigned int i = 0; i < CurrentLevel->players.size(); i++)
-		{
-			// Save player's position and the execute the tic command
-			Float3 pt = CurrentLevel->players[i]->pos_;
-			CurrentLevel->players[i]->ExecuteTick();
-
-			// Collision detection with floors and walls
-			if (!NewPositionIsValid(CurrentLevel->players[i], CurrentLevel))
+			// Update game logic
+			if (netgame && netgame->Rollback())
 			{
-				// Compute the position where the player would be if he slide against the wall
-				Float2 pos = MoveOnCollision(pt, CurrentLevel->players[i]->pos_, CurrentLevel->players[i], CurrentLevel);
+				// Tics that were predicted wrong are simulated again before this one. Only this one is drawn.
+				netgame->Simulate(*CurrentLevel, TicCount);
 
-				// Move the player back to its original position
-				// TODO: Shouldn't any 'momentum' be cancelled?
-				CurrentLevel->players[i]->pos_ = pt;
-
-				// Try to slide the player against the walls to a valid position
-				if (NewPositionIsValid(CurrentLevel->players[i], CurrentLevel))
+				// The demo and quitting only use the commands that every player agreed on, once the tics ran with them
+				for (; ConfirmedTic < netgame->Verified(); ConfirmedTic++)
 				{
-					// Make sure the walls didn't push the player inside other players
-					if (!PlayerToPlayersCollision(CurrentLevel->players[i], CurrentLevel->players))
+					// The state before this tic, so that the demo can start here
+					if (DemoWrite.NeedsKeyframe())
 					{
-						// Set the new position
-						CurrentLevel->players[i]->pos_.x = pos.x;
-						CurrentLevel->players[i]->pos_.y = pos.y;
+						const vector<unsigned char>* state = netgame->State(ConfirmedTic);
+
+						if (state)
+							DemoWrite.Keyframe(*state);
 					}
-					else
+
+					for (unsigned int i = 0; i < CurrentLevel->players.size(); i++)
 					{
-						// TODO: Shouldn't any 'momentum' be cancelled?
-						CurrentLevel->players[i]->pos_ = pt;
+						const Ticcmd& cmd = netgame->Command(ConfirmedTic, i);
+
+						if (DemoWrite.IsOpen())
+							DemoWrite.Write(cmd);
+
+						Quit = Quit || cmd.quit;
 					}
 				}
 			}
+			else
+			{
+				CurrentLevel->RunTic();
+
+				if (netgame)
+					netgame->Record(TicCount, *CurrentLevel);
+			}
 
-			// Player to player collision check
-			if (PlayerToPlayersCollision(CurrentLevel->players[i], CurrentLevel->players))
+			// Checksums of the state. With rollback, only the tics that every player agreed on.
+			if (DemoWrite.IsOpen())
 			{
-				for (unsigned int j = 0; j < CurrentLevel->players.size(); j++)
+				if (netgame && netgame->Rollback())
 				{
-					if (CurrentLevel->players[i] != CurrentLevel->players[j])
+					for (; SummedTic < netgame->Verified(); SummedTic++)
 					{
-						// Execute Player to player collision
-						CurrentLevel->players[i]->pos_ = PlayerToPlayerCollisionReact(CurrentLevel->players[i], CurrentLevel->players[j]);
-						// Check if there's a collision between players
-						if (PlayerToPlayerCollision(CurrentLevel->players[i], CurrentLevel->players[j]) ||
-							!NewPositionIsValid(CurrentLevel->players[i], CurrentLevel))
-						{
-							// Restore original position
-							CurrentLevel->players[i]->pos_ = pt;
-						}
+						if (SummedTic % DEMO_CHECKSUM_INTERVAL == DEMO_CHECKSUM_INTERVAL - 1)
+							DemoWrite.Checksum(SummedTic, netgame->Checksum(SummedTic));
 					}
 				}
+				else if (TicCount % DEMO_CHECKSUM_INTERVAL == DEMO_CHECKSUM_INTERVAL - 1)
+				{
+					DemoWrite.Checksum(TicCount, netgame ? netgame->Checksum(TicCount) : CurrentLevel->Checksum());
+				}
 			}
 
-			// Adjust height
-			AdjustPlayerToFloor(CurrentLevel->players[i], CurrentLevel);
+			// The demo must play the same way as when it was recorded. Only the first tic that's different matters.
+			if (DemoRead.IsOpen() && !DemoDesynced && DemoRead.Checksum(TicCount, DemoSum))
+			{
+				if (DemoSum == CurrentLevel->Checksum())
+				{
+					DemoMatched = TicCount + 1;
+				}
+				else
+				{
+					cerr << "Demo desyncs between tic " << DemoMatched << " and tic " << TicCount << ". Checksum is " << CurrentLevel->Checksum()
+						<< " instead of " << DemoSum << ". State written to '" << DemoName << ".desync'." << endl;
 
-			// Handle fire here to avoid circular inclusion/dependecy with 'Level' in the Player class
-			if (CurrentLevel->players[i]->ShouldFire)
+					ofstream dump(DemoName + ".desync");
+					dump << "State after tic " << TicCount << '\n' << CurrentLevel->DescribeState();
+					DemoDesynced = true;
+				}
+			}
+
+			// Status of the player for debugging purposes
+			if (Debug)
 			{
-				Hitscan(CurrentLevel, CurrentLevel->players[i], CurrentLevel->players);
-				CurrentLevel->players[i]->ShouldFire = false;
+				cout << "X: " << CurrentLevel->play->PosX() << "\t\tY: " << CurrentLevel->play->PosY()
+					<< "\t\tZ: " << CurrentLevel->play->PosZ() << "\t\tA: " << CurrentLevel->play->Angle << endl;
 			}
-		}
 
-		CurrentLevel->UpdateThings();
+			TicCount++;
 
-		// Draw Screen
-		if (frameSkip == 0 || TicCount % frameSkip == 0)
-		{
-			DrawScreen(window, CurrentLevel->play, CurrentLevel, FrameDelay);
+			// Find a player who quits and terminate the game. With rollback, only the confirmed commands count.
+			for (unsigned int i = 0; i < CurrentLevel->players.size() && !(netgame && netgame->Rollback()); i++)
+			{
+				if (!Quit)
+				{
+					Quit = CurrentLevel->players[i]->Cmd.quit;
+				}
+			}
 		}
 
-		// Play sound
-
-		// Status of the player for debugging purposes
-		if (Debug)
+		// Draw Screen. The things are drawn between the last two tics.
+		if (!Headless && !Quit)
 		{
-			cout << "X: " << CurrentLevel->play->PosX() << "\t\tY: " << CurrentLevel->play->PosY()
-				<< "\t\tZ: " << CurrentLevel->play->PosZ() << "\t\tA: " << CurrentLevel->play->Angle << endl;
+			if (Cache::Instance()->Streaming())
+			{
+				CurrentLevel->StreamTextures(StreamDistance);
+				Cache::Instance()->Pump();
+			}
+
+			DrawScreen(window, CurrentLevel->play, CurrentLevel, FrameDelay, (float)Lag.count() / TicTime.count());
 		}
 
-		TicCount++;
+		// Play sound
 
-		if (!Fast)
-		{
-			auto end = chrono::system_clock::now();
-			FrameDelay = chrono::duration_cast<chrono::microseconds>(end - start).count();
+		auto end = chrono::steady_clock::now();
+		FrameDelay = chrono::duration_cast<chrono::microseconds>(end - start).count();
 
-			const int FRAMERATE = 60;
-			const float DELAY = 1000 / FRAMERATE;
-			if (FrameDelay / 1000 < DELAY)
-				SDL_Delay(DELAY - FrameDelay / 1000);
-		}
+		// The framerate can be capped. Without a screen to show, the game runs as fast as the other players allow.
+		FramePacer.Wait();
 
 		// Detect OpenGL errors
 		GLenum ErrorCode;
-		while ((ErrorCode = glGetError()) != GL_NO_ERROR)
+		while (!Headless && (ErrorCode = glGetError()) != GL_NO_ERROR)
 		{
 			cerr << (const char*)gluErrorString(ErrorCode) << endl;
 		}
-
-		// Find a player who quits and terminate the game.
-		for (unsigned int i = 0; i < CurrentLevel->players.size(); i++)
-		{
-			if (!Quit)
-			{
-				Quit = CurrentLevel->players[i]->Cmd.quit;
-			}
-		}
 	}
 	while (!Quit);
 
@@ -457,26 +673,45 @@ int mainloop(int argc, const char* argv[])
 	if (CurrentLevel != nullptr)
 		delete CurrentLevel;
 
-	if (DemoWrite.is_open())
+	if (netgame)
+	{
+		netgame->PrintStats();
+		delete netgame;
+	}
+
+	if (netsim)
 	{
-		DemoWrite.close();
+		netsim->PrintStats();
+		delete netsim;
+	}
+
+	if (DemoWrite.IsOpen())
+	{
+		DemoWrite.Close();
 		cout << "Demo written to disk." << endl;
 	}
 
-	if (DemoRead.is_open())
+	if (DemoRead.IsOpen())
 	{
-		DemoRead.close();
+		DemoRead.Close();
 		cout << "Demo playback ended." << endl;
 	}
 
-	if (Fast)
+	if (Fast || Headless)
 	{
 		// Print benchmark time
-		cout << "Game terminated after " << chrono::duration_cast<chrono::milliseconds>(chrono::system_clock::now() - GameStartTime).count() << "ms." << endl;
+		cout << "Game terminated after " << chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - GameStartTime).count() << "ms." << endl;
 	}
 
+	FramePacer.PrintStats();
+
 	// Close OpenGL stuff
-	Close_OpenGL(window);
+	Cache::Instance()->PrintStats();
+	if (!Headless)
+		Close_OpenGL(window);
+
+	// Unmap the archives
+	Resources::DestroyInstance();
 
 	return EXIT_SUCCESS;
 }
@@ -0,0 +1,955 @@
+// Copyright (C) 2020 Alexandre-Xavier Labonté-Lamoureux
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// netgame.cpp
+// Lockstep multiplayer game. The local commands are sent a few tics before
+// they are executed so that the game doesn't have to wait for the other players.
+// Clients send their commands to the server. When the server has the commands
+// of every player for a tic, it sends them to every client in a single message.
+// Messages repeat the tics that were not acknowledged, so a lost message doesn't stall the game.
+// In rollback mode, the game doesn't wait for the commands of the other players.
+// They are predicted, and the game goes back in time when a prediction was wrong.
+
+#include "netgame.h"
+#include "ticcmd.h"
+#include "player.h"
+#include "level.h"
+
+#include <algorithm>	/* max */
+#include <chrono>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+using namespace std;
+
+// Every message starts with its type (1 byte).
+// Client tics: player number (1 byte), acknowledgement (4 bytes), first tic (4 bytes), number of tics (1 byte),
+// then the commands of the player. Every tic that the server didn't acknowledge is sent again, up to 'REDUNDANT_TICS'.
+// Server tics: acknowledgement, first tic, number of tics, then the commands of every player for each tic.
+// The acknowledgement is the first tic that the sender is missing. Tics and acknowledgements are little-endian.
+// Both can end with the last checkpoint of the sender: a tic (4 bytes) and the checksum of the state after it (4 bytes).
+const unsigned char MESSAGE_TICS = 0;
+const unsigned int CLIENT_HEADER_SIZE = 10;
+const unsigned int SERVER_HEADER_SIZE = 9;
+const unsigned int CHECKSUM_SIZE = 8;
+
+// Chat: sender's player number (1 byte), sequence number (4 bytes), tic (4 bytes), author (1 byte), length (1 byte), text.
+// Acknowledgement: sender's player number, then the next sequence number that it expects. Messages are sent
+// again until they are acknowledged. The server relays the messages of the clients to every client.
+const unsigned char MESSAGE_CHAT = 1;
+const unsigned char MESSAGE_CHAT_ACK = 2;
+const unsigned int CHAT_HEADER_SIZE = 11;
+const unsigned int CHAT_ACK_SIZE = 5;
+
+// A command only has the fields that changed since the previous command of the same player in the message.
+// The first one is compared to an empty command. The first byte tells what follows.
+const unsigned char DELTA_FORWARD = 1;
+const unsigned char DELTA_LATERAL = 2;
+const unsigned char DELTA_ROTATION = 4;
+const unsigned char DELTA_VERTICAL = 8;
+const unsigned char DELTA_FIRE = 16;	// Value, not a change
+const unsigned char DELTA_QUIT = 32;	// Value, not a change
+
+const int RESEND_INTERVAL = 50;	// ms. Time to wait for a message before sending the unacknowledged tics or chat again.
+
+const unsigned int NO_MISPREDICTION = numeric_limits<unsigned int>::max();
+
+static void WriteTic(vector<unsigned char>& message, unsigned int tic)
+{
+	message.insert(message.end(), {(unsigned char)tic, (unsigned char)(tic >> 8), (unsigned char)(tic >> 16), (unsigned char)(tic >> 24)});
+}
+
+static unsigned int ReadTic(const unsigned char* message)
+{
+	return message[0] | (message[1] << 8) | (message[2] << 16) | ((unsigned int)message[3] << 24);
+}
+
+static void WriteDelta(vector<unsigned char>& message, const Ticcmd& cmd, const Ticcmd& previous)
+{
+	size_t flags = message.size();
+	message.push_back(0);
+
+	if (cmd.forward != previous.forward)
+	{
+		message[flags] |= DELTA_FORWARD;
+		message.push_back(cmd.forward);
+	}
+
+	if (cmd.lateral != previous.lateral)
+	{
+		message[flags] |= DELTA_LATERAL;
+		message.push_back(cmd.lateral);
+	}
+
+	if (cmd.rotation != previous.rotation)
+	{
+		message[flags] |= DELTA_ROTATION;
+		message.insert(message.end(), {(unsigned char)cmd.rotation, (unsigned char)(cmd.rotation >> 8)});
+	}
+
+	if (cmd.vertical != previous.vertical)
+	{
+		message[flags] |= DELTA_VERTICAL;
+		message.insert(message.end(), {(unsigned char)cmd.vertical, (unsigned char)(cmd.vertical >> 8)});
+	}
+
+	if (cmd.fire)
+		message[flags] |= DELTA_FIRE;
+
+	if (cmd.quit)
+		message[flags] |= DELTA_QUIT;
+}
+
+// 'cmd' must hold the previous command. Returns the position after the command, or 0 if the message is too short.
+static size_t ReadDelta(const unsigned char* message, size_t size, size_t pos, Ticcmd& cmd)
+{
+	if (pos >= size)
+		return 0;
+
+	unsigned char flags = message[pos++];
+	size_t needed = ((flags & DELTA_FORWARD) ? 1 : 0) + ((flags & DELTA_LATERAL) ? 1 : 0) +
+		((flags & DELTA_ROTATION) ? 2 : 0) + ((flags & DELTA_VERTICAL) ? 2 : 0);
+
+	if (pos + needed > size)
+		return 0;
+
+	if (flags & DELTA_FORWARD)
+		cmd.forward = message[pos++];
+
+	if (flags & DELTA_LATERAL)
+		cmd.lateral = message[pos++];
+
+	if (flags & DELTA_ROTATION)
+	{
+		cmd.rotation = message[pos] | (message[pos + 1] << 8);
+		pos += 2;
+	}
+
+	if (flags & DELTA_VERTICAL)
+	{
+		cmd.vertical = message[pos] | (message[pos + 1] << 8);
+		pos += 2;
+	}
+
+	cmd.fire = flags & DELTA_FIRE;
+	cmd.quit = flags & DELTA_QUIT;
+
+	return pos;
+}
+
+// The chat doesn't change the game
+static bool SameAction(const Ticcmd& a, const Ticcmd& b)
+{
+	return a.forward == b.forward && a.lateral == b.lateral && a.rotation == b.rotation &&
+		a.vertical == b.vertical && a.fire == b.fire && a.quit == b.quit;
+}
+
+NetGame::NetGame(Transport& network, unsigned int players, unsigned int delay, unsigned int window): network_(network)
+{
+	if ((delay == 0 && window == 0) || delay + window >= BACKUPTICS / 2)
+	{
+		throw runtime_error("The input delay must be between 1 and " + to_string(BACKUPTICS / 2 - 1) +
+			" tics, including the rollback window. It can only be 0 with rollback.");
+	}
+
+	if (players > MAXPLAYERS)
+	{
+		throw runtime_error("There can't be more than " + to_string(MAXPLAYERS) + " players");
+	}
+
+	players_ = players;
+	delay_ = delay;
+	sendTic_ = delay;
+	confirmed_ = 0;
+	serverAck_ = delay;
+	window_ = window;
+	mispredicted_ = NO_MISPREDICTION;
+
+	cmds_.resize(BACKUPTICS * players_);
+	tics_.resize(BACKUPTICS * players_, -1);
+	acked_.resize(players_, delay);
+	chatAcked_.resize(players_, 0);
+	chatReceived_.resize(players_, 0);
+
+	// Large enough for the biggest message without chat so that sending doesn't allocate
+	packet_.reserve(CLIENT_HEADER_SIZE + REDUNDANT_TICS * players_ * (1 + TICCMD_SIZE) + CHECKSUM_SIZE);
+	received_.resize(players_, delay);
+	secondStart_ = start_ = chrono::steady_clock::now();
+	submitted_.resize(BACKUPTICS, start_);
+	applied_ = 0;
+
+	sums_.resize(BACKUPTICS);
+	sumTics_.resize(BACKUPTICS, -1);
+	worlds_.resize(BACKUPTICS / CHECKSUM_INTERVAL);
+	worldTics_.resize(BACKUPTICS / CHECKSUM_INTERVAL, -1);
+	remoteTics_.resize(players_);
+	remoteSums_.resize(players_);
+	remotePending_.resize(players_, false);
+
+	if (window_ > 0)
+	{
+		guesses_.resize(BACKUPTICS * players_);
+		guessTics_.resize(BACKUPTICS * players_, -1);
+		snapshots_.resize(window_ + 1);
+		snapshotTics_.resize(window_ + 1, -1);
+	}
+
+	// Nobody sent anything for the first tics, so they are empty
+	for (unsigned int tic = 0; tic < delay_; tic++)
+	{
+		for (unsigned int i = 0; i < players_; i++)
+		{
+			Ticcmd cmd;
+			cmd.id = i;
+			Store(tic, cmd);
+		}
+	}
+
+	confirmed_ = delay;
+}
+
+unsigned int NetGame::Delay() const
+{
+	return delay_;
+}
+
+bool NetGame::Rollback() const
+{
+	return window_ > 0;
+}
+
+unsigned int NetGame::Window() const
+{
+	return window_;
+}
+
+void NetGame::Store(unsigned int tic, const Ticcmd& cmd)
+{
+	unsigned int slot = (tic % BACKUPTICS) * players_ + cmd.id;
+
+	// Tics are sent many times. Old tics would overwrite the newer ones in the same slot.
+	if (tics_[slot] == (int)tic || tic < confirmed_)
+		return;
+
+	cmds_[slot] = cmd;
+	tics_[slot] = tic;
+
+	// Acknowledge the tics that arrived without a gap
+	while (tics_[(received_[cmd.id] % BACKUPTICS) * players_ + cmd.id] == (int)received_[cmd.id])
+	{
+		received_[cmd.id]++;
+	}
+
+	// The tic was already simulated with another command
+	if (window_ > 0 && tic < simulated_ && guessTics_[slot] == (int)tic && !SameAction(guesses_[slot], cmd))
+	{
+		mispredicted_ = min(mispredicted_, tic);
+	}
+}
+
+void NetGame::Confirm()
+{
+	unsigned int previous = confirmed_;
+
+	while (Ready(confirmed_))
+	{
+		confirmed_++;
+	}
+
+	// The server sends the tics as soon as they are complete
+	if (network_.isServer() && (confirmed_ != previous || resend_))
+	{
+		resend_ = false;
+		Send();
+	}
+}
+
+void NetGame::SetLog(const string& path)
+{
+	log_.open(path);
+
+	if (!log_.is_open())
+	{
+		throw runtime_error("Could not open '" + path + "'");
+	}
+
+	log_ << "tic stall_ms latency_ms" << endl;
+}
+
+void NetGame::Submit(const Ticcmd& cmd)
+{
+	submitted_[sendTic_ % BACKUPTICS] = chrono::steady_clock::now();
+	Store(sendTic_, cmd);
+	sendTic_++;
+
+	if (!network_.isServer())
+		Send();
+
+	Confirm();
+}
+
+void NetGame::Send()
+{
+	if (!network_.isServer())
+	{
+		// Every tic that the server didn't acknowledge
+		unsigned int me = network_.myPlayer();
+		unsigned int first = serverAck_;
+		unsigned int count = min(sendTic_ - min(first, sendTic_), REDUNDANT_TICS);
+
+		if (count == 0)
+			return;
+
+		packet_.clear();
+		packet_.push_back(MESSAGE_TICS);
+		packet_.push_back(me);
+		WriteTic(packet_, confirmed_);
+		WriteTic(packet_, first);
+		packet_.push_back(count);
+
+		Ticcmd previous;
+		for (unsigned int tic = first; tic < first + count; tic++)
+		{
+			const Ticcmd& cmd = cmds_[(tic % BACKUPTICS) * players_ + me];
+			WriteDelta(packet_, cmd, previous);
+			previous = cmd;
+		}
+
+		WriteChecksum(packet_);
+		network_.send(packet_);
+		Count(packet_.size(), true);
+		ResendChat();
+		return;
+	}
+
+	// Each client gets the complete tics that it didn't acknowledge
+	for (unsigned int client = 1; client < players_; client++)
+	{
+		unsigned int first = acked_[client];
+		unsigned int count = min(confirmed_ - min(first, confirmed_), REDUNDANT_TICS);
+
+		if (count == 0)
+			continue;
+
+		packet_.clear();
+		packet_.push_back(MESSAGE_TICS);
+		WriteTic(packet_, received_[client]);
+		WriteTic(packet_, first);
+		packet_.push_back(count);
+
+		for (unsigned int i = 0; i < players_; i++)
+		{
+			Ticcmd previous;
+			for (unsigned int tic = first; tic < first + count; tic++)
+			{
+				// Commands are grouped by player so that they are compared to the same player's previous tic
+				const Ticcmd& cmd = cmds_[(tic % BACKUPTICS) * players_ + i];
+				WriteDelta(packet_, cmd, previous);
+				previous = cmd;
+			}
+		}
+
+		WriteChecksum(packet_);
+		network_.sendTo(client, packet_);
+		Count(packet_.size(), true);
+	}
+
+	ResendChat();
+}
+
+void NetGame::Chat(const string& text)
+{
+	ChatMessage chat = {sendTic_, network_.myPlayer(), text.substr(0, MAX_CHAT_LENGTH)};
+
+	chats_.push_back(chat);
+	chatLog_.push_back(chat);
+
+	for (unsigned int peer = 0; peer < players_; peer++)
+	{
+		if (peer != network_.myPlayer() && (network_.isServer() || peer == 0))
+			SendChat(peer, chatLog_.size() - 1);
+	}
+}
+
+bool NetGame::NextChat(unsigned int tic, ChatMessage& chat)
+{
+	if (chats_.empty() || chats_.front().tic > tic)
+		return false;
+
+	chat = chats_.front();
+	chats_.pop_front();
+
+	return true;
+}
+
+void NetGame::SendChat(unsigned int peer, unsigned int sequence)
+{
+	const ChatMessage& chat = chatLog_[sequence];
+
+	packet_.clear();
+	packet_.push_back(MESSAGE_CHAT);
+	packet_.push_back(network_.myPlayer());
+	WriteTic(packet_, sequence);
+	WriteTic(packet_, chat.tic);
+	packet_.push_back(chat.player);
+	packet_.push_back(chat.text.size());
+	packet_.insert(packet_.end(), chat.text.begin(), chat.text.end());
+
+	if (network_.isServer())
+		network_.sendTo(peer, packet_);
+	else
+		network_.send(packet_);
+
+	Count(packet_.size(), true);
+	chatSent_ = chrono::steady_clock::now();
+}
+
+void NetGame::ResendChat()
+{
+	if (chrono::steady_clock::now() - chatSent_ < chrono::milliseconds(RESEND_INTERVAL))
+		return;
+
+	for (unsigned int peer = 0; peer < players_; peer++)
+	{
+		if (peer == network_.myPlayer() || (!network_.isServer() && peer != 0))
+			continue;
+
+		for (unsigned int sequence = chatAcked_[peer]; sequence < chatLog_.size(); sequence++)
+		{
+			SendChat(peer, sequence);
+		}
+	}
+}
+
+void NetGame::ReadChat(const unsigned char* message, size_t size)
+{
+	if (size < CHAT_HEADER_SIZE || size < CHAT_HEADER_SIZE + message[10])
+		return;
+
+	unsigned int peer = message[0];
+
+	if (peer >= players_ || (network_.isServer() == (peer == 0)))
+		return;
+
+	unsigned int sequence = ReadTic(message + 1);
+
+	// Messages from the same peer are accepted in order. The ones that were already received are acknowledged again.
+	if (sequence == chatReceived_[peer])
+	{
+		ChatMessage chat = {ReadTic(message + 5), message[9], string(message + CHAT_HEADER_SIZE, message + CHAT_HEADER_SIZE + message[10])};
+		chatReceived_[peer]++;
+
+		// The messages of this player were already shown when they were sent
+		if (chat.player != network_.myPlayer())
+			chats_.push_back(chat);
+
+		// Give it to the other clients
+		if (network_.isServer())
+		{
+			chatLog_.push_back(chat);
+
+			for (unsigned int client = 1; client < players_; client++)
+			{
+				SendChat(client, chatLog_.size() - 1);
+			}
+		}
+	}
+
+	packet_.clear();
+	packet_.push_back(MESSAGE_CHAT_ACK);
+	packet_.push_back(network_.myPlayer());
+	WriteTic(packet_, chatReceived_[peer]);
+
+	if (network_.isServer())
+		network_.sendTo(peer, packet_);
+	else
+		network_.send(packet_);
+
+	Count(packet_.size(), true);
+}
+
+void NetGame::ReadChatAck(const unsigned char* message, size_t size)
+{
+	if (size < CHAT_ACK_SIZE || message[0] >= players_)
+		return;
+
+	chatAcked_[message[0]] = max(chatAcked_[message[0]], min(ReadTic(message + 1), (unsigned int)chatLog_.size()));
+}
+
+void NetGame::ReadCommands(const unsigned char* message, size_t size)
+{
+	if (size < CLIENT_HEADER_SIZE)
+		return;
+
+	unsigned int player = message[0];
+
+	if (player == 0 || player >= players_)
+		return;
+
+	acked_[player] = max(acked_[player], ReadTic(message + 1));
+	unsigned int first = ReadTic(message + 5);
+	unsigned int count = message[9];
+	size_t pos = CLIENT_HEADER_SIZE;
+
+	Ticcmd cmd;
+	cmd.id = player;
+	unsigned int received = received_[player];
+
+	for (unsigned int tic = first; tic < first + count; tic++)
+	{
+		pos = ReadDelta(message, size, pos, cmd);
+
+		if (pos == 0)
+			return;
+
+		Store(tic, cmd);
+	}
+
+	ReadChecksum(player, message, size, pos);
+
+	// Only old tics means that the client is waiting. It may have lost the last complete tics.
+	if (received_[player] == received && acked_[player] < confirmed_)
+		resend_ = true;
+}
+
+void NetGame::ReadBundles(const unsigned char* message, size_t size)
+{
+	if (size < SERVER_HEADER_SIZE)
+		return;
+
+	serverAck_ = max(serverAck_, ReadTic(message));
+	unsigned int first = ReadTic(message + 4);
+	unsigned int count = message[8];
+	size_t pos = SERVER_HEADER_SIZE;
+
+	for (unsigned int i = 0; i < players_; i++)
+	{
+		Ticcmd cmd;
+		cmd.id = i;
+
+		for (unsigned int tic = first; tic < first + count; tic++)
+		{
+			pos = ReadDelta(message, size, pos, cmd);
+
+			if (pos == 0)
+				return;
+
+			Store(tic, cmd);
+		}
+	}
+
+	ReadChecksum(0, message, size, pos);
+}
+
+bool NetGame::Poll(int timeout)
+{
+	const unsigned char* message;
+	size_t size;
+	bool received = false;
+
+	// Only the first read waits. Messages are decoded where they were received.
+	while (network_.receive(message, size, received ? 0 : timeout))
+	{
+		received = true;
+		Count(size, false);
+
+		if (size == 0)
+			continue;
+
+		if (message[0] == MESSAGE_CHAT)
+			ReadChat(message + 1, size - 1);
+		else if (message[0] == MESSAGE_CHAT_ACK)
+			ReadChatAck(message + 1, size - 1);
+		else if (network_.isServer())
+			ReadCommands(message + 1, size - 1);
+		else
+			ReadBundles(message + 1, size - 1);
+	}
+
+	Confirm();
+
+	return received;
+}
+
+void NetGame::Count(size_t bytes, bool sent)
+{
+	if (sent)
+		bytesSent_ += bytes;
+	else
+		bytesReceived_ += bytes;
+
+	auto now = chrono::steady_clock::now();
+
+	if (now - secondStart_ >= chrono::seconds(1))
+	{
+		bandwidth_ = secondBytes_;
+		peakBandwidth_ = max(peakBandwidth_, bandwidth_);
+		secondBytes_ = 0;
+		secondStart_ = now;
+	}
+
+	secondBytes_ += bytes;
+}
+
+unsigned long NetGame::Bandwidth() const
+{
+	return bandwidth_;
+}
+
+bool NetGame::Ready(unsigned int tic) const
+{
+	for (unsigned int i = 0; i < players_; i++)
+	{
+		if (tics_[(tic % BACKUPTICS) * players_ + i] != (int)tic)
+			return false;
+	}
+
+	return true;
+}
+
+bool NetGame::Runnable(unsigned int tic) const
+{
+	// With rollback, the tics that are missing commands are predicted
+	if (window_ > 0)
+		return tic < confirmed_ + window_;
+
+	return Ready(tic);
+}
+
+bool NetGame::TryWait(unsigned int tic)
+{
+	// Read what arrived since the last call
+	Poll(0);
+
+	auto now = chrono::steady_clock::now();
+
+	if (Runnable(tic))
+	{
+		long stall = 0;
+
+		if (waiting_)
+		{
+			stall = chrono::duration_cast<chrono::milliseconds>(now - waitStart_).count();
+			stalls_++;
+			stallTime_ += stall;
+			waiting_ = false;
+		}
+
+		// It may be called again for the same tic
+		if (tic == applied_)
+			Apply(tic, stall);
+
+		return true;
+	}
+
+	if (!waiting_)
+	{
+		waiting_ = true;
+		waitStart_ = now;
+		resent_ = now;
+	}
+
+	// The duration takes its count by reference, and the constant has no definition outside of the class
+	const int timeout = Transport::TIMEOUT;
+
+	if (now - waitStart_ >= chrono::milliseconds(timeout))
+	{
+		throw runtime_error("Timed out while waiting for the other players at tic " + to_string(tic));
+	}
+
+	// A message may have been lost. The tics that were not acknowledged are sent again.
+	if (now - resent_ >= chrono::milliseconds(RESEND_INTERVAL))
+	{
+		Send();
+		resent_ = now;
+	}
+
+	return false;
+}
+
+void NetGame::Wait(unsigned int tic)
+{
+	while (!TryWait(tic))
+		Poll(RESEND_INTERVAL);
+}
+
+void NetGame::Apply(unsigned int tic, long stall)
+{
+	auto now = chrono::steady_clock::now();
+	double latency = chrono::duration_cast<chrono::microseconds>(now - submitted_[tic % BACKUPTICS]).count() / 1000.0;
+
+	latency_ += latency;
+	applied_ = tic + 1;
+
+	if (log_.is_open())
+		log_ << tic << ' ' << stall << ' ' << latency << '\n';
+}
+
+unsigned int NetGame::Missing() const
+{
+	// The first tic that isn't complete is the one that holds the game
+	for (unsigned int i = 0; i < players_; i++)
+	{
+		if (tics_[(confirmed_ % BACKUPTICS) * players_ + i] != (int)confirmed_)
+			return i;
+	}
+
+	return 0;
+}
+
+void NetGame::Load(unsigned int tic, const vector<Player*>& players)
+{
+	for (unsigned int i = 0; i < players_ && i < players.size(); i++)
+	{
+		players[i]->Cmd = cmds_[(tic % BACKUPTICS) * players_ + i];
+	}
+}
+
+unsigned int NetGame::Confirmed() const
+{
+	return confirmed_;
+}
+
+const Ticcmd& NetGame::Command(unsigned int tic, unsigned int player) const
+{
+	return cmds_[(tic % BACKUPTICS) * players_ + player];
+}
+
+void NetGame::Predict(unsigned int tic, const vector<Player*>& players)
+{
+	for (unsigned int i = 0; i < players_ && i < players.size(); i++)
+	{
+		unsigned int slot = (tic % BACKUPTICS) * players_ + i;
+
+		if (tics_[slot] == (int)tic)
+		{
+			players[i]->Cmd = cmds_[slot];
+			guessTics_[slot] = -1;
+			continue;
+		}
+
+		// Guess that the player does the same thing as in the last command that arrived
+		Ticcmd guess;
+		for (unsigned int back = 1; back <= tic && back < BACKUPTICS / 2; back++)
+		{
+			unsigned int previous = ((tic - back) % BACKUPTICS) * players_ + i;
+
+			if (tics_[previous] == (int)(tic - back))
+			{
+				guess = cmds_[previous];
+				break;
+			}
+		}
+
+		guess.id = i;
+		guess.quit = false;
+
+		guesses_[slot] = guess;
+		guessTics_[slot] = tic;
+		players[i]->Cmd = guess;
+	}
+}
+
+void NetGame::Step(Level& level, unsigned int tic)
+{
+	level.SaveWorld(snapshots_[tic % snapshots_.size()], tic);
+	snapshotTics_[tic % snapshots_.size()] = tic;
+	Predict(tic, level.players);
+	level.RunTic();
+	Record(tic, level);
+	simulated_ = max(simulated_, tic + 1);
+}
+
+void NetGame::Simulate(Level& level, unsigned int tic)
+{
+	// Don't predict too far. It also limits how many tics are simulated again.
+	Wait(tic);
+
+	if (mispredicted_ < tic)
+	{
+		unsigned int depth = tic - mispredicted_;
+		rollbacks_++;
+		resimulated_ += depth;
+		maxDepth_ = max(maxDepth_, depth);
+
+		const vector<unsigned char>& snapshot = snapshots_[mispredicted_ % snapshots_.size()];
+		level.LoadWorld(snapshot.data(), snapshot.size());
+
+		for (unsigned int t = mispredicted_; t < tic; t++)
+		{
+			Step(level, t);
+		}
+	}
+
+	mispredicted_ = NO_MISPREDICTION;
+	Step(level, tic);
+
+	// Every confirmed tic was simulated with the right commands
+	Verify(min(confirmed_, simulated_));
+}
+
+void NetGame::Record(unsigned int tic, const Level& level)
+{
+	auto start = chrono::steady_clock::now();
+
+	sums_[tic % BACKUPTICS] = level.Checksum();
+	sumTics_[tic % BACKUPTICS] = tic;
+
+	// The state of the checkpoints is kept in case they don't match. The buffers keep their memory.
+	if (tic % CHECKSUM_INTERVAL == CHECKSUM_INTERVAL - 1)
+	{
+		unsigned int slot = (tic / CHECKSUM_INTERVAL) % worlds_.size();
+		level.SaveWorld(worlds_[slot], tic);
+		worldTics_[slot] = tic;
+	}
+
+	recordTime_ += chrono::steady_clock::now() - start;
+	recorded_++;
+
+	// In lockstep, every tic that runs is final
+	if (window_ == 0)
+		Verify(tic + 1);
+}
+
+void NetGame::Verify(unsigned int verified)
+{
+	if (verified <= verified_)
+		return;
+
+	verified_ = verified;
+
+	for (unsigned int i = 0; i < players_; i++)
+	{
+		if (remotePending_[i])
+			Compare(i);
+	}
+}
+
+unsigned int NetGame::Verified() const
+{
+	return verified_;
+}
+
+const vector<unsigned char>* NetGame::State(unsigned int tic) const
+{
+	// The tics before it must be final
+	if (window_ == 0 || tic > verified_ || snapshotTics_[tic % snapshots_.size()] != (int)tic)
+		return nullptr;
+
+	return &snapshots_[tic % snapshots_.size()];
+}
+
+unsigned int NetGame::Checksum(unsigned int tic) const
+{
+	return sums_[tic % BACKUPTICS];
+}
+
+bool NetGame::Desynced() const
+{
+	return desynced_;
+}
+
+void NetGame::WriteChecksum(vector<unsigned char>& message) const
+{
+	if (verified_ < CHECKSUM_INTERVAL)
+		return;
+
+	unsigned int tic = verified_ / CHECKSUM_INTERVAL * CHECKSUM_INTERVAL - 1;
+	WriteTic(message, tic);
+	WriteTic(message, sums_[tic % BACKUPTICS]);
+}
+
+void NetGame::ReadChecksum(unsigned int peer, const unsigned char* message, size_t size, size_t pos)
+{
+	if (pos + CHECKSUM_SIZE > size)
+		return;
+
+	unsigned int tic = ReadTic(message + pos);
+
+	// It's sent many times
+	if (remoteTics_[peer] == tic && !remotePending_[peer])
+		return;
+
+	remoteTics_[peer] = tic;
+	remoteSums_[peer] = ReadTic(message + pos + 4);
+	remotePending_[peer] = true;
+	Compare(peer);
+}
+
+void NetGame::Compare(unsigned int peer)
+{
+	unsigned int tic = remoteTics_[peer];
+
+	if (tic >= verified_)
+		return;
+
+	remotePending_[peer] = false;
+
+	// Too old to compare
+	if (sumTics_[tic % BACKUPTICS] != (int)tic)
+		return;
+
+	if (sums_[tic % BACKUPTICS] == remoteSums_[peer])
+	{
+		if (!desynced_)
+			matched_ = max(matched_, tic + 1);
+
+		return;
+	}
+
+	if (desynced_)
+		return;
+
+	desynced_ = true;
+	unsigned int me = network_.myPlayer();
+
+	cerr << "Desync with player " << peer + 1 << " between tic " << matched_ << " and tic " << tic << ". Checksum is "
+		<< sums_[tic % BACKUPTICS] << " here and " << remoteSums_[peer] << " for player " << peer + 1 << "." << endl;
+
+	// The other player finds the desync too and writes its own state
+	unsigned int slot = (tic / CHECKSUM_INTERVAL) % worlds_.size();
+	if (worldTics_[slot] == (int)tic)
+	{
+		string name = "desync-" + to_string(me + 1) + ".txt";
+		ofstream dump(name);
+		dump << "State of player " << me + 1 << " after tic " << tic << '\n' << Level::DescribeWorld(worlds_[slot].data(), worlds_[slot].size())
+			<< "Checksum " << sums_[tic % BACKUPTICS] << '\n';
+		cerr << "State written to '" << name << "'." << endl;
+	}
+}
+
+void NetGame::PrintStats() const
+{
+	long seconds = max(1L, (long)chrono::duration_cast<chrono::seconds>(chrono::steady_clock::now() - start_).count());
+
+	cout << "Network: input delay of " << delay_ << " tics, waited for other players " << stalls_ << " times ("
+		<< stallTime_ << " ms), " << latency_ / max(1U, applied_) << " ms from input to execution on average." << endl;
+	cout << "Bandwidth: sent " << bytesSent_ << " bytes, received " << bytesReceived_ << " bytes ("
+		<< (bytesSent_ + bytesReceived_) / seconds << " bytes/s on average, peak of " << max(peakBandwidth_, secondBytes_) << " bytes/s)." << endl;
+
+	if (recorded_ > 0)
+		cout << "Checksums: " << chrono::duration<double, micro>(recordTime_).count() / recorded_ << " us per tic on average." << endl;
+
+	if (network_.dropped() > 0)
+		cout << "Network: " << network_.dropped() << " messages were dropped because the I/O thread was behind." << endl;
+
+	if (window_ > 0)
+	{
+		cout << "Rollback: window of " << window_ << " tics, " << rollbacks_ << " rollbacks, "
+			<< resimulated_ << " tics simulated again, deepest was " << maxDepth_ << " tics." << endl;
+	}
+}
@@ -0,0 +1,191 @@
+// Copyright (C) 2020 Alexandre-Xavier Labonté-Lamoureux
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// netgame.h
+// Lockstep multiplayer game. The local commands are sent a few tics before
+// they are executed so that the game doesn't have to wait for the other players.
+// Clients send their commands to the server. When the server has the commands
+// of every player for a tic, it sends them to every client in a single message.
+// Messages repeat the tics that were not acknowledged, so a lost message doesn't stall the game.
+// In rollback mode, the game doesn't wait for the commands of the other players.
+// They are predicted, and the game goes back in time when a prediction was wrong.
+
+#ifndef NETGAME_H
+#define NETGAME_H
+
+#include "transport.h"
+#include "ticcmd.h"
+#include "player.h"
+#include "level.h"	/* Level */
+
+#include <chrono>
+#include <deque>
+#include <fstream>
+#include <string>
+#include <vector>
+using namespace std;
+
+const unsigned int MAXPLAYERS = 64;	// Player numbers must fit in 6 bits
+const unsigned int BACKUPTICS = 128;	// Number of tics kept for each player. The input delay must be less than half of it.
+const unsigned int DEFAULT_INPUT_DELAY = 4;	// About 64 ms at 60 tics per second
+const unsigned int DEFAULT_ROLLBACK_WINDOW = 8;	// Number of tics that can be predicted before waiting for the other players
+const unsigned int REDUNDANT_TICS = 32;	// Maximum number of unacknowledged tics that are sent again in each message
+const unsigned int MAX_CHAT_LENGTH = 255;
+const unsigned int CHECKSUM_INTERVAL = 16;	// Tics between the checksums that are compared with the other players
+
+class NetGame
+{
+private:
+	Transport& network_;
+	unsigned int players_;
+	unsigned int delay_;
+	unsigned int sendTic_;	// Tic of the next local command
+	unsigned int confirmed_;	// Every tic before this one has the commands of every player
+
+	// Acknowledgements. Each one is the first tic that is missing.
+	unsigned int serverAck_;	// Client only. Own tics that the server has.
+	vector<unsigned int> acked_;	// Server only. Complete tics that each client has.
+	vector<unsigned int> received_;	// Tics that arrived from each player
+	bool resend_ = false;	// Server only. A client needs the complete tics again.
+
+	vector<unsigned char> packet_;	// Reused for every message
+
+	// Chat. The messages are sent again until they are acknowledged. Peers are indexed by player number.
+	vector<ChatMessage> chatLog_;	// Messages to send. A message's sequence number is its index.
+	vector<unsigned int> chatAcked_;	// Messages of the log that each peer has
+	vector<unsigned int> chatReceived_;	// Messages that arrived from each peer
+	deque<ChatMessage> chats_;	// Messages to show
+	chrono::steady_clock::time_point chatSent_;
+
+	// Commands that were received for each tic and player. Slots are reused after 'BACKUPTICS' tics.
+	vector<Ticcmd> cmds_;
+	vector<int> tics_;	// Tic stored in each slot, -1 if it's empty
+
+	// Rollback
+	unsigned int window_;	// Tics that can be predicted, 0 for lockstep
+	unsigned int simulated_ = 0;	// Tics that were simulated at least once
+	unsigned int mispredicted_;	// First tic that was simulated with a wrong guess
+	vector<Ticcmd> guesses_;	// Commands that were predicted for each tic and player
+	vector<int> guessTics_;	// Tic of the guess in each slot, -1 if it's empty
+	vector<vector<unsigned char>> snapshots_;	// State of the game at the beginning of the last tics (see Level::SaveWorld)
+	vector<int> snapshotTics_;	// Tic of the snapshot in each slot, -1 if it's empty
+
+	// Waiting for the other players
+	bool waiting_ = false;
+	chrono::steady_clock::time_point waitStart_;
+	chrono::steady_clock::time_point resent_;
+
+	// Desync detection. The state after a tic is final once the tic is confirmed and was not predicted wrong.
+	vector<unsigned int> sums_;	// Checksum of the state after each tic
+	vector<int> sumTics_;	// Tic of the checksum in each slot, -1 if it's empty
+	vector<vector<unsigned char>> worlds_;	// State after the last checkpoints. Turned into text only after a desync.
+	vector<int> worldTics_;
+	unsigned int verified_ = 0;	// Every tic before this one has a final checksum
+	vector<unsigned int> remoteTics_;	// Last checkpoint that arrived from each peer
+	vector<unsigned int> remoteSums_;
+	vector<bool> remotePending_;	// The checkpoint was not compared yet
+	unsigned int matched_ = 0;	// Last checkpoint that was the same for everyone, plus one
+	bool desynced_ = false;
+
+	// Timing of each tic
+	vector<chrono::steady_clock::time_point> submitted_;	// When the local command of a tic was sampled
+	unsigned int applied_;	// Next tic that will be run
+	ofstream log_;
+
+	// Statistics
+	unsigned int stalls_ = 0;
+	unsigned long stallTime_ = 0;	// ms
+	unsigned int rollbacks_ = 0;
+	unsigned int resimulated_ = 0;	// Tics
+	unsigned int maxDepth_ = 0;
+	unsigned long bytesSent_ = 0;
+	unsigned long bytesReceived_ = 0;
+	unsigned long secondBytes_ = 0;	// Sent and received during the current second
+	unsigned long bandwidth_ = 0;	// Bytes per second during the last second
+	unsigned long peakBandwidth_ = 0;
+	double latency_ = 0;	// ms. Sum of the time between the sampling of the local commands and their execution.
+	chrono::steady_clock::duration recordTime_{0};	// Spent computing the checksums and copying the checkpoints
+	unsigned int recorded_ = 0;	// Tics, including the ones that were simulated again
+	chrono::steady_clock::time_point start_;
+	chrono::steady_clock::time_point secondStart_;
+
+	void Store(unsigned int tic, const Ticcmd& cmd);
+	void Confirm();
+	bool Runnable(unsigned int tic) const;
+	void Predict(unsigned int tic, const vector<Player*>& players);	// Give the commands of a tic to the players. Missing ones are guessed.
+	void Step(Level& level, unsigned int tic);
+	void Send();	// Send the tics that were not acknowledged. The server sends the complete tics to each client.
+	void ReadCommands(const unsigned char* message, size_t size);	// Server only
+	void ReadBundles(const unsigned char* message, size_t size);	// Client only
+	void SendChat(unsigned int peer, unsigned int sequence);
+	void ResendChat();
+	void ReadChat(const unsigned char* message, size_t size);
+	void ReadChatAck(const unsigned char* message, size_t size);
+	void Count(size_t bytes, bool sent);
+	void Apply(unsigned int tic, long stall);	// The tic is about to run. 'stall' is how long it was waited for in ms.
+	void Verify(unsigned int verified);	// The checksums before 'verified' are final
+	void WriteChecksum(vector<unsigned char>& message) const;	// Last checkpoint, at the end of the tics
+	void ReadChecksum(unsigned int peer, const unsigned char* message, size_t size, size_t pos);
+	void Compare(unsigned int peer);	// Compare the last checkpoint of a peer with our own
+
+public:
+	NetGame(Transport& network, unsigned int players, unsigned int delay, unsigned int window = 0);
+
+	// Writes a line for every tic with the time spent waiting for it and the time since its local command was sampled
+	void SetLog(const string& path);
+
+	unsigned int Delay() const;
+	bool Rollback() const;
+	unsigned int Window() const;
+
+	// Send the local command. It will be executed after the input delay. The delay must cover the
+	// round trip to the server because the commands of a client come back from the server.
+	void Submit(const Ticcmd& cmd);
+
+	// Read the messages that arrived. Returns false if none arrived within 'timeout' ms.
+	bool Poll(int timeout);
+
+	bool Ready(unsigned int tic) const;	// True if the commands of every player arrived for that tic
+	bool TryWait(unsigned int tic);	// True if a tic can be run. Never blocks. Throws if the game waited for too long.
+	void Wait(unsigned int tic);	// Wait until a tic can be run. Throws if it takes too long.
+	unsigned int Missing() const;	// A player whose command is needed for the game to continue
+	void Load(unsigned int tic, const vector<Player*>& players);	// Give the commands of a tic to the players
+
+	// Chat messages are sent apart from the commands. They are shown when the tic of the next command is reached.
+	void Chat(const string& text);
+	bool NextChat(unsigned int tic, ChatMessage& chat);	// Messages of every player whose tic was reached, including this player
+
+	unsigned int Confirmed() const;	// Every tic before this one has the commands of every player
+	const Ticcmd& Command(unsigned int tic, unsigned int player) const;	// Only for the tics that are confirmed
+
+	// Rollback mode. Runs a tic right away, but first goes back to the first tic that was
+	// predicted wrong and simulates the tics again. That's at most 'window' tics per call.
+	void Simulate(Level& level, unsigned int tic);
+
+	// Rollback mode. State before a tic that is verified, like for the keyframes of a demo. nullptr once it's not kept anymore.
+	const vector<unsigned char>* State(unsigned int tic) const;
+
+	// Checksums of the state after each tic. Lockstep mode must record every tic after running it.
+	// Rollback mode records them while simulating.
+	void Record(unsigned int tic, const Level& level);
+	unsigned int Verified() const;	// Every tic before this one has a final checksum
+	unsigned int Checksum(unsigned int tic) const;	// Only for the tics that are verified
+	bool Desynced() const;
+
+	unsigned long Bandwidth() const;	// Bytes sent and received during the last second
+	void PrintStats() const;
+};
+
+#endif	// NETGAME_H
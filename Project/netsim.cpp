@@ -0,0 +1,215 @@
+// Copyright (C) 2020 Alexandre-Xavier Labonté-Lamoureux
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// netsim.cpp
+// Simulates a bad network on top of another transport
+
+#include "netsim.h"
+#include "strutils.h"	/* Split */
+
+#include <algorithm>	/* max */
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+using namespace std;
+
+NetConditions NetConditions::Parse(const string& text)
+{
+	vector<string> values = Split(text, ',');
+	NetConditions c;
+
+	if (values.size() > 0 && !values[0].empty())
+		c.latency = stoi(values[0]);
+	if (values.size() > 1)
+		c.jitter = stoi(values[1]);
+	if (values.size() > 2)
+		c.loss = stof(values[2]);
+	if (values.size() > 3)
+		c.reorder = stof(values[3]);
+	if (values.size() > 4)
+		c.bandwidth = stoul(values[4]);
+	if (values.size() > 5)
+		c.seed = stoul(values[5]);
+
+	if (c.latency < 0 || c.jitter < 0 || c.loss < 0 || c.loss > 100 || c.reorder < 0 || c.reorder > 100)
+	{
+		throw runtime_error("Invalid network conditions '" + text + "'. The format is 'latency,jitter,loss,reorder,bandwidth,seed'.");
+	}
+
+	return c;
+}
+
+NetSim::NetSim(Transport& transport, const NetConditions& conditions): transport_(transport), conditions_(conditions)
+{
+	random_.seed(conditions_.seed + transport_.myPlayer());
+	outgoingFree_ = incomingFree_ = chrono::steady_clock::now();
+}
+
+bool NetSim::Lose()
+{
+	if (conditions_.loss <= 0)
+		return false;
+
+	uniform_real_distribution<float> percent(0, 100);
+
+	if (percent(random_) >= conditions_.loss)
+		return false;
+
+	lost_++;
+	return true;
+}
+
+NetSim::Time NetSim::Arrival(Time& free, size_t size)
+{
+	Time now = chrono::steady_clock::now();
+
+	// The link sends one message at a time
+	if (conditions_.bandwidth > 0)
+	{
+		free = max(free, now) + chrono::microseconds(size * 1000000 / conditions_.bandwidth);
+		now = free;
+	}
+
+	int delay = conditions_.latency;
+
+	if (conditions_.jitter > 0)
+	{
+		uniform_int_distribution<int> jitter(-conditions_.jitter, conditions_.jitter);
+		delay = max(0, delay + jitter(random_));
+	}
+
+	if (conditions_.reorder > 0)
+	{
+		uniform_real_distribution<float> percent(0, 100);
+
+		if (percent(random_) < conditions_.reorder)
+		{
+			// Late enough for the next messages to arrive first
+			delay += conditions_.latency + conditions_.jitter + 1;
+			reordered_++;
+		}
+	}
+
+	return now + chrono::milliseconds(delay);
+}
+
+void NetSim::Pump()
+{
+	Time now = chrono::steady_clock::now();
+
+	while (!outgoing_.empty() && outgoing_.begin()->first <= now)
+	{
+		Delayed& message = outgoing_.begin()->second;
+
+		if (message.peer == 0)
+			transport_.send(message.data);
+		else
+			transport_.sendTo(message.peer, message.data);
+
+		outgoing_.erase(outgoing_.begin());
+	}
+
+	const unsigned char* data;
+	size_t size;
+
+	while (transport_.receive(data, size, 0))
+	{
+		if (Lose())
+			continue;
+
+		Delayed message;
+		message.peer = 0;
+		message.data.assign(data, data + size);
+		incoming_.emplace(Arrival(incomingFree_, size), move(message));
+	}
+}
+
+bool NetSim::isServer()
+{
+	return transport_.isServer();
+}
+
+unsigned int NetSim::myPlayer()
+{
+	return transport_.myPlayer();
+}
+
+void NetSim::send(const unsigned char* data, size_t size)
+{
+	if (!Lose())
+	{
+		Delayed message;
+		message.peer = 0;
+		message.data.assign(data, data + size);
+		outgoing_.emplace(Arrival(outgoingFree_, size), move(message));
+	}
+
+	Pump();
+}
+
+void NetSim::send(const vector<unsigned char>& message)
+{
+	send(message.data(), message.size());
+}
+
+void NetSim::sendTo(unsigned int player, const vector<unsigned char>& message)
+{
+	if (!Lose())
+	{
+		Delayed delayed;
+		delayed.peer = player;
+		delayed.data = message;
+		outgoing_.emplace(Arrival(outgoingFree_, message.size()), move(delayed));
+	}
+
+	Pump();
+}
+
+bool NetSim::receive(const unsigned char*& data, size_t& size, int timeout)
+{
+	Time deadline = chrono::steady_clock::now() + chrono::milliseconds(timeout);
+
+	while (true)
+	{
+		Pump();
+
+		if (!incoming_.empty() && incoming_.begin()->first <= chrono::steady_clock::now())
+		{
+			current_.swap(incoming_.begin()->second.data);
+			incoming_.erase(incoming_.begin());
+
+			data = current_.data();
+			size = current_.size();
+			return true;
+		}
+
+		if (chrono::steady_clock::now() >= deadline)
+			return false;
+
+		this_thread::sleep_for(chrono::milliseconds(1));
+	}
+}
+
+unsigned long NetSim::dropped() const
+{
+	return transport_.dropped();
+}
+
+void NetSim::PrintStats() const
+{
+	cout << "Simulated network: " << conditions_.latency << " ms of latency, " << conditions_.jitter << " ms of jitter, "
+		<< lost_ << " messages lost, " << reordered_ << " reordered." << endl;
+}
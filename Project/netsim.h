@@ -0,0 +1,87 @@
+// Copyright (C) 2020 Alexandre-Xavier Labonté-Lamoureux
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// netsim.h
+// Simulates a bad network on top of another transport. Messages are delayed, lost,
+// reordered and slowed down in both directions, so that the netcode can be tested on a single computer.
+
+#ifndef NETSIM_H
+#define NETSIM_H
+
+#include "transport.h"
+
+#include <chrono>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+using namespace std;
+
+struct NetConditions
+{
+	int latency = 0;	// ms, in each direction
+	int jitter = 0;	// ms. The latency varies by up to this much.
+	float loss = 0;	// Percentage of the messages that are lost
+	float reorder = 0;	// Percentage of the messages that are held back so that the next ones arrive first
+	unsigned long bandwidth = 0;	// Bytes per second in each direction, 0 if there's no limit
+	unsigned int seed = 1;	// The same seed gives the same conditions
+
+	// Format is 'latency,jitter,loss,reorder,bandwidth,seed'. The values at the end can be left out.
+	static NetConditions Parse(const string& text);
+};
+
+class NetSim: public Transport
+{
+private:
+	struct Delayed
+	{
+		unsigned int peer;	// Like 'Network', 0 is every client for the server
+		vector<unsigned char> data;
+	};
+
+	typedef chrono::steady_clock::time_point Time;
+
+	Transport& transport_;
+	NetConditions conditions_;
+	mt19937 random_;	// Not the game's random numbers, which must stay the same for every player
+
+	multimap<Time, Delayed> outgoing_;	// Sorted by the time when they arrive
+	multimap<Time, Delayed> incoming_;
+	Time outgoingFree_;	// When the link is done with the previous message
+	Time incomingFree_;
+	vector<unsigned char> current_;	// Message returned by 'receive'
+
+	unsigned long lost_ = 0;
+	unsigned long reordered_ = 0;
+
+	bool Lose();
+	Time Arrival(Time& free, size_t size);
+	void Pump();	// Passes the messages that arrived to the transport and reads the ones it received
+
+public:
+	NetSim(Transport& transport, const NetConditions& conditions);
+
+	bool isServer() override;
+	unsigned int myPlayer() override;
+	void send(const unsigned char* data, size_t size) override;
+	void send(const vector<unsigned char>& message) override;
+	void sendTo(unsigned int player, const vector<unsigned char>& message) override;
+	bool receive(const unsigned char*& data, size_t& size, int timeout) override;
+	unsigned long dropped() const override;
+
+	void PrintStats() const;
+};
+
+#endif	// NETSIM_H
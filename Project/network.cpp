@@ -17,6 +17,8 @@
 // Networking component
 
 #include <zmq.hpp>
+#include <chrono>
+#include <thread>
 #include <string>	// to_string
 #include <iostream>	// cout
 #include <vector>
@@ -28,25 +30,57 @@
 using namespace std;
 using namespace zmq;
 
+// Every socket of the process uses the same context so that 'inproc' endpoints can be shared
+static context_t& Context()
+{
+	static context_t context(1);
+	return context;
+}
+
+const string SHM_PREFIX = "shm://";
+
+// A port or an address, or a complete endpoint
+static string Endpoint(const string& location, const string& prefix)
+{
+	if (location.find("://") != string::npos)
+		return location;
+
+	return prefix + location;
+}
+
 Network::Network()
 {
 	id_ = 0;
+	server_ = false;
 	sock_ = nullptr;
-	context_ = nullptr;
 }
 
 Network::~Network()
 {
-	if (sock_)
+	if (io_)
+	{
+		quit_ = true;
+		io_->join();
+		delete io_;
+	}
+
+	for (unsigned int i = 0; i < peers_.size(); i++)
 	{
-		delete sock_;
-		delete context_;
+		delete peers_[i];
 	}
+
+	delete sock_;
+	delete shm_;
 }
 
 bool Network::enabled()
 {
-	return sock_ != nullptr;
+	return sock_ != nullptr || shm_ != nullptr;
+}
+
+bool Network::isServer()
+{
+	return server_;
 }
 
 unsigned int Network::myPlayer()
@@ -55,92 +89,275 @@ unsigned int Network::myPlayer()
 	return id_;
 }
 
+void Network::send(const unsigned char* data, size_t size)
+{
+	if (shm_)
+	{
+		shm_->send(data, size);
+		return;
+	}
+
+	Check();
+
+	Packet* packet = outgoing_.Back();
+
+	if (!packet)
+	{
+		// The I/O thread is stuck. The message is sent again later like a lost one.
+		dropped_++;
+		return;
+	}
+
+	packet->peer = 0;
+	packet->data.assign(data, data + size);
+	outgoing_.Push();
+}
+
 void Network::send(const vector<unsigned char>& message)
 {
-	message_t request(message.size());
-	memcpy(request.data(), &message[0], message.size());
+	send(message.data(), message.size());
+}
 
-	try
+void Network::sendTo(unsigned int player, const vector<unsigned char>& message)
+{
+	if (shm_)
 	{
-		sock_->send(request);
+		shm_->sendTo(player, message);
+		return;
 	}
-	catch (zmq::error_t const& err)
+
+	if (!server_ || player == 0 || player > peers_.size())
+	{
+		throw runtime_error("Network send error. There's no player " + to_string(player) + ".");
+	}
+
+	Check();
+
+	Packet* packet = outgoing_.Back();
+
+	if (!packet)
 	{
-		throw runtime_error("Network send error. Timed out while waiting for peer.");
+		dropped_++;
+		return;
 	}
+
+	packet->peer = player;
+	packet->data.assign(message.begin(), message.end());
+	outgoing_.Push();
 }
 
-vector<unsigned char> Network::receive()
+bool Network::receive(const unsigned char*& data, size_t& size, int timeout)
 {
-	message_t message;
+	if (shm_)
+		return shm_->receive(data, size, timeout);
 
-	try
+	Check();
+
+	// The game is done with the previous message
+	if (reading_)
 	{
-		sock_->recv(&message);
+		incoming_.Pop();
+		reading_ = false;
 	}
-	catch (zmq::error_t const& err)
+
+	Packet* packet = incoming_.Front();
+
+	if (!packet && timeout > 0)
 	{
-		throw runtime_error("Network receive error. Timed out while waiting for peer.");
+		auto deadline = chrono::steady_clock::now() + chrono::milliseconds(timeout);
+
+		while (!packet && chrono::steady_clock::now() < deadline)
+		{
+			this_thread::sleep_for(chrono::milliseconds(NETWORK_POLL_INTERVAL));
+			Check();
+			packet = incoming_.Front();
+		}
 	}
 
-	vector<unsigned char> v(message.size());
-	memcpy(v.data(), message.data(), message.size());
+	if (!packet)
+		return false;
+
+	// The message is read in its slot
+	reading_ = true;
+	data = packet->data.data();
+	size = packet->data.size();
+
+	return true;
+}
+
+unsigned long Network::dropped() const
+{
+	return shm_ ? shm_->dropped() : dropped_;
+}
+
+void Network::Check()
+{
+	if (failed_)
+	{
+		throw runtime_error(error_);
+	}
+}
 
-	return v;
+void Network::Start()
+{
+	io_ = new thread(&Network::Run, this);
 }
 
-void Network::sendString(const string& s)
+void Network::Run()
 {
-	message_t message(s.size());
-	memcpy(message.data(), s.data(), s.size());
+	pollitem_t item = {static_cast<void*>(*sock_), 0, ZMQ_POLLIN, 0};
+	message_t message;
+
+	try
+	{
+		while (!quit_)
+		{
+			// Send what the game queued since the last time
+			while (const Packet* packet = outgoing_.Front())
+			{
+				Transmit(*packet);
+				outgoing_.Pop();
+			}
+
+			// When the game doesn't keep up, the messages wait in the queue of ZeroMQ
+			Packet* slot = incoming_.Back();
+
+			if (!slot)
+			{
+				this_thread::sleep_for(chrono::milliseconds(NETWORK_POLL_INTERVAL));
+				continue;
+			}
+
+			if (poll(&item, 1, NETWORK_POLL_INTERVAL) <= 0)
+				continue;
+
+			while (slot && sock_->recv(&message, ZMQ_DONTWAIT))
+			{
+				// Skip the identity of the client
+				if (server_)
+					sock_->recv(&message);
+
+				const unsigned char* data = static_cast<const unsigned char*>(message.data());
+				slot->peer = 0;
+				slot->data.assign(data, data + message.size());
+				incoming_.Push();
 
-	sock_->send(message);
+				slot = incoming_.Back();
+			}
+		}
+	}
+	catch (zmq::error_t const& err)
+	{
+		error_ = "Network error. " + string(err.what());
+		failed_ = true;
+	}
 }
 
-string Network::receiveString()
+void Network::Transmit(const Packet& packet)
 {
-	message_t reply;
-	sock_->recv(&reply);
+	if (!server_)
+	{
+		// ZeroMQ queues the message and sends it in the background
+		message_t message(packet.data.data(), packet.data.size());
+		sock_->send(message);
+		return;
+	}
+
+	// The router needs to know to which client the message goes
+	for (unsigned int i = 0; i < peers_.size(); i++)
+	{
+		if (packet.peer != 0 && packet.peer != i + 1)
+			continue;
+
+		message_t identity;
+		identity.copy(peers_[i]);
+		message_t message(packet.data.data(), packet.data.size());
 
-	return string(static_cast<char*>(reply.data()), reply.size());
+		sock_->send(identity, ZMQ_SNDMORE);
+		sock_->send(message);
+	}
 }
 
-void Network::startServer(const string& port, const string& info)
+void Network::startServer(const string& port, const string& info, unsigned int clients)
 {
-	context_ = new context_t(1);
-	sock_ = new socket_t(*context_, ZMQ_REP);
+	if (port.compare(0, SHM_PREFIX.size(), SHM_PREFIX) == 0)
+	{
+		shm_ = new SharedMemory;
+		shm_->startServer(port.substr(SHM_PREFIX.size()), info, clients);
+		server_ = true;
+		id_ = 0;
+		return;
+	}
+
+	sock_ = new socket_t(Context(), ZMQ_ROUTER);
+	server_ = true;
+
+	// Don't wait for unsent messages when the game ends
+	sock_->setsockopt(ZMQ_LINGER, 0);
 
 	cout << "Starting local server on port '" << port << "'" << endl;
-	sock_->bind("tcp://*:" + port);
+	sock_->bind(Endpoint(port, "tcp://*:"));
 
-	// Init game
-	receiveString();
-	sendString(info);
+	// Wait for every client before the game starts so that nobody times out
+	while (peers_.size() < clients)
+	{
+		message_t* identity = new message_t;
+		message_t hello;
+		sock_->recv(identity);
+		sock_->recv(&hello);
+		peers_.push_back(identity);
 
-	// Allow the socket to timeout while the game is running
-	sock_->setsockopt(ZMQ_RCVTIMEO, &TIMEOUT, sizeof(int));
-	sock_->setsockopt(ZMQ_SNDTIMEO, &TIMEOUT, sizeof(int));
+		cout << "Player " << peers_.size() + 1 << " of " << clients + 1 << " joined." << endl;
+	}
+
+	// Init game. Every client gets its player number first.
+	for (unsigned int i = 0; i < peers_.size(); i++)
+	{
+		string settings = to_string(i + 1) + '\n' + info;
+		message_t identity;
+		identity.copy(peers_[i]);
+		message_t message(settings.data(), settings.size());
+
+		sock_->send(identity, ZMQ_SNDMORE);
+		sock_->send(message);
+	}
 
 	id_ = 0;
+	Start();
 }
 
 string Network::connectClient(const string& location)
 {
-	context_ = new context_t(1);
-	sock_ = new socket_t(*context_, ZMQ_REQ);
+	if (location.compare(0, SHM_PREFIX.size(), SHM_PREFIX) == 0)
+	{
+		shm_ = new SharedMemory;
+		string info = shm_->connectClient(location.substr(SHM_PREFIX.size()));
+		id_ = shm_->myPlayer();
+		return info;
+	}
+
+	sock_ = new socket_t(Context(), ZMQ_DEALER);
+
+	sock_->setsockopt(ZMQ_LINGER, 0);
 
 	cout << "Connecting to server at '" << location << "'" << endl;
-	sock_->connect("tcp://" + location);
+	sock_->connect(Endpoint(location, "tcp://"));
 
 	// Init game
-	sendString("Hello, World!");
-	string settings = receiveString();
+	string hello = "Hello, World!";
+	message_t request(hello.data(), hello.size());
+	sock_->send(request);
 
-	// Allow the socket to timeout while the game is running
-	sock_->setsockopt(ZMQ_RCVTIMEO, &TIMEOUT, sizeof(int));
-	sock_->setsockopt(ZMQ_SNDTIMEO, &TIMEOUT, sizeof(int));
+	// Waits until every player joined
+	message_t reply;
+	sock_->recv(&reply);
+	string settings(static_cast<char*>(reply.data()), reply.size());
 
-	id_ = 1;
+	// The first line is the player number
+	size_t newline = settings.find('\n');
+	id_ = stoul(settings.substr(0, newline));
+	cout << "Joined the game as player " << id_ + 1 << "." << endl;
+	Start();
 
-	return settings;
+	return settings.substr(newline + 1);
 }
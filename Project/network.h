@@ -14,41 +14,82 @@
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 //
 // network.h
-// Networking component
+// Networking component. After the handshake, the socket belongs to a thread that
+// does all the I/O. The game exchanges messages with it through lock-free rings.
+
+#ifndef NETWORK_H
+#define NETWORK_H
+
+#include "ring.h"
+#include "transport.h"
+#include "shmem.h"
 
 #include <zmq.hpp>
+#include <atomic>
+#include <thread>
 #include <vector>
 #include <string>
 
 using namespace std;
 using namespace zmq;
 
-class Network
+const unsigned int NETWORK_RING_SIZE = 256;	// Messages that can wait in each direction
+const int NETWORK_POLL_INTERVAL = 1;	// ms. The I/O thread sends what was queued at least this often.
+
+class Network: public Transport
 {
 private:
+	// Message between the game and the I/O thread
+	struct Packet
+	{
+		unsigned int peer;	// 0 is every client for the server, else it's the player number
+		vector<unsigned char> data;	// Keeps its capacity when the slot is reused
+	};
+
 	socket_t* sock_;
-	context_t* context_;
-	unsigned int id_;		// For 2 players, 0-1
+	unsigned int id_;		// The server is 0, clients are 1 to 63
+	bool server_;
+	vector<message_t*> peers_;		// Identity of each client (server only). Client 'i' is at 'i - 1'.
+
+	thread* io_ = nullptr;
+	atomic<bool> quit_{false};
+	atomic<bool> failed_{false};
+	string error_;		// Set by the I/O thread before 'failed_'
+	Ring<Packet, NETWORK_RING_SIZE> outgoing_;	// Written by the game
+	Ring<Packet, NETWORK_RING_SIZE> incoming_;	// Written by the I/O thread
+	bool reading_ = false;	// The front of 'incoming_' is being read by the game
+	unsigned long dropped_ = 0;	// Messages that didn't fit in 'outgoing_'
+
+	SharedMemory* shm_ = nullptr;	// Used instead of the socket for a 'shm://' address
+
+	void Start();	// Starts the I/O thread once the handshake is done
+	void Run();		// I/O thread
+	void Transmit(const Packet& packet);
+	void Check();	// Throws the error of the I/O thread
 
 public:
 	Network();
 	~Network();
 
-	const int TIMEOUT = 10 * 1000;	// ms
-
 	bool enabled();
-	unsigned int myPlayer();
-
-	// Used when sharing tic commands
-	void send(const vector<unsigned char>& message);
-	vector<unsigned char> receive();
+	bool isServer() override;
+	unsigned int myPlayer() override;
 
-	// Used when the server shares the game's settings with the client
-	void sendString(const string& s);
-	string receiveString();
+	// Used when sharing tic commands. They only queue the message, so they never block. If the queue
+	// is full, the message is dropped like a lost packet. The server sends to every client, clients send to the server.
+	void send(const unsigned char* data, size_t size) override;
+	void send(const vector<unsigned char>& message) override;
+	void sendTo(unsigned int player, const vector<unsigned char>& message) override;	// Server only
+	// Waits up to 'timeout' ms. Returns false if nothing arrived. 'data' is valid until the next call.
+	// With a timeout of 0, it doesn't make any system call.
+	bool receive(const unsigned char*& data, size_t& size, int timeout) override;
+	unsigned long dropped() const override;
 
-	// Handshake
-	void startServer(const string& port, const string& info);
+	// Handshake. The server waits for every client, then gives each of them an ID and the game's settings.
+	// A port or an address can be replaced by a ZeroMQ endpoint, like 'inproc://game' to play in the same process.
+	// With 'shm://name', the players that are on the same computer use shared memory instead of ZeroMQ.
+	void startServer(const string& port, const string& info, unsigned int clients);
 	string connectClient(const string& location);
 };
 
+#endif	// NETWORK_H
@@ -0,0 +1,462 @@
+// Copyright (C) 2020 Alexandre-Xavier Labonté-Lamoureux
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// optimize.cpp
+// Geometry optimizations that are done when a level is loaded
+
+#include "optimize.h"
+#include "plane.h"
+#include "vecmath.h"
+
+#include <algorithm>	/* rotate */
+#include <cmath>		/* fabs, floor, round, sqrt */
+#include <map>
+#include <tuple>
+#include <utility>		/* pair */
+#include <vector>
+using namespace std;
+
+const float NORMAL_EPSILON = 0.0001f;	// Planes with normals that differ by less than this are parallel
+const float COPLANAR_EPSILON = 0.01f;	// Maximal distance of a vertex from the plane it's merged with
+const float COLLINEAR_EPSILON = 0.0001f;	// Edges that make a smaller angle than this (in radians) are a straight line
+const float UV_EPSILON = 0.001f;	// Maximal error of a texture coordinate when a level has UVs
+
+// Without UVs, the texture is stretched on each plane. Neighbors are only merged if the texture
+// keeps the same scale, so this only covers the rounding errors.
+const float STRETCH_EPSILON = 0.001f;
+
+/****************************** Welding ******************************/
+
+unsigned int WeldVertices(vector<Float3>& vertices, vector<Plane>& planes, float epsilon)
+{
+	// Vertices are put in a grid so that only the neighboring cells need to be searched
+	map<tuple<long, long, long>, vector<unsigned int>> grid;
+	vector<unsigned int> remap(vertices.size());
+	unsigned int welded = 0;
+
+	for (unsigned int i = 0; i < vertices.size(); i++)
+	{
+		long x = floor(vertices[i].x / epsilon);
+		long y = floor(vertices[i].y / epsilon);
+		long z = floor(vertices[i].z / epsilon);
+
+		remap[i] = i;
+
+		for (long dx = -1; dx <= 1 && remap[i] == i; dx++)
+		{
+			for (long dy = -1; dy <= 1 && remap[i] == i; dy++)
+			{
+				for (long dz = -1; dz <= 1 && remap[i] == i; dz++)
+				{
+					auto cell = grid.find(make_tuple(x + dx, y + dy, z + dz));
+					if (cell == grid.end())
+						continue;
+
+					for (unsigned int j = 0; j < cell->second.size(); j++)
+					{
+						Float3 diff = subVectors(vertices[i], vertices[cell->second[j]]);
+
+						if (sqrt(dotProduct(diff, diff)) <= epsilon)
+						{
+							remap[i] = cell->second[j];
+							welded++;
+							break;
+						}
+					}
+				}
+			}
+		}
+
+		// Only the vertices that are kept can be welded to
+		if (remap[i] == i)
+			grid[make_tuple(x, y, z)].push_back(i);
+	}
+
+	// Point to the welded vertices and remove the corners that now appear twice in a row
+	vector<Plane> kept;
+	kept.reserve(planes.size());
+
+	for (unsigned int i = 0; i < planes.size(); i++)
+	{
+		Plane& p = planes[i];
+
+		for (unsigned int j = 0; j < p.Count; j++)
+		{
+			p.Vertices[j] = remap[p.Vertices[j]];
+		}
+
+		for (unsigned int j = 0; j < p.Count && p.Count > 1; )
+		{
+			if (p.Vertices[j] == p.Vertices[(j + 1) % p.Count])
+				p.RemoveVertex(j);
+			else
+				j++;
+		}
+
+		// A plane needs at least three corners
+		if (p.Count >= 3)
+			kept.push_back(p);
+	}
+
+	planes.swap(kept);
+
+	// Remove unused vertices
+	vector<unsigned int> index(vertices.size(), 0);
+	vector<bool> used(vertices.size(), false);
+	vector<Float3> compact;
+
+	for (unsigned int i = 0; i < planes.size(); i++)
+	{
+		for (unsigned int j = 0; j < planes[i].Count; j++)
+		{
+			used[planes[i].Vertices[j]] = true;
+		}
+	}
+
+	for (unsigned int i = 0; i < vertices.size(); i++)
+	{
+		if (used[i])
+		{
+			index[i] = compact.size();
+			compact.push_back(vertices[i]);
+		}
+	}
+
+	vertices.swap(compact);
+
+	for (unsigned int i = 0; i < planes.size(); i++)
+	{
+		for (unsigned int j = 0; j < planes[i].Count; j++)
+		{
+			planes[i].Vertices[j] = index[planes[i].Vertices[j]];
+		}
+
+		planes[i].Process(vertices);
+	}
+
+	return welded;
+}
+
+/****************************** Merging ******************************/
+
+// A corner of a polygon that's being built
+struct Corner
+{
+	unsigned int vertex;
+	unsigned int uv;
+	Float2 tex;	// Texture coordinate
+};
+
+// Texture coordinates of a plane's corners
+static void Mapping(const Plane& p, const vector<Float2>& uvs, bool hasUVs, Float2* tex)
+{
+	for (unsigned int i = 0; i < p.Count; i++)
+	{
+		if (hasUVs)
+			tex[i] = uvs[p.UVs[i]];
+		else
+			tex[i] = {i == 1 || i == 2 ? p.Xscale : 0, i < 2 ? p.Yscale : 0};	// Same as 'DrawScreen'
+	}
+}
+
+static bool IsInteger(float value)
+{
+	return fabs(value - round(value)) <= UV_EPSILON;
+}
+
+static bool SameTex(const Float2& a, const Float2& b, float epsilon)
+{
+	return fabs(a.x - b.x) <= epsilon && fabs(a.y - b.y) <= epsilon;
+}
+
+// Remove the corners that are in the middle of a straight edge
+static void RemoveCollinear(vector<Corner>& corners, const vector<Float3>& vertices)
+{
+	for (unsigned int i = 0; i < corners.size() && corners.size() > 3; )
+	{
+		const Float3& prev = vertices[corners[(i + corners.size() - 1) % corners.size()].vertex];
+		const Float3& cur = vertices[corners[i].vertex];
+		const Float3& next = vertices[corners[(i + 1) % corners.size()].vertex];
+
+		Float3 in = normalize(subVectors(cur, prev));
+		Float3 out = normalize(subVectors(next, cur));
+		Float3 cross = crossProduct(in, out);
+
+		if (sqrt(dotProduct(cross, cross)) <= COLLINEAR_EPSILON && dotProduct(in, out) > 0)
+			corners.erase(corners.begin() + i);
+		else
+			i++;
+	}
+}
+
+static bool IsConvex(const vector<Corner>& corners, const vector<Float3>& vertices, const Float3& normal)
+{
+	for (unsigned int i = 0; i < corners.size(); i++)
+	{
+		const Float3& prev = vertices[corners[(i + corners.size() - 1) % corners.size()].vertex];
+		const Float3& cur = vertices[corners[i].vertex];
+		const Float3& next = vertices[corners[(i + 1) % corners.size()].vertex];
+
+		if (dotProduct(crossProduct(subVectors(cur, prev), subVectors(next, cur)), normal) <= 0)
+			return false;
+	}
+
+	return true;
+}
+
+// Check that the texture coordinates of the original corners are where the merged polygon would put them.
+// OpenGL interpolates the texture linearly, so the texture coordinates must be an affine function of the position.
+static bool IsAffine(const vector<Corner>& merged, const vector<Corner>& originals, const vector<Float3>& vertices, float epsilon)
+{
+	const Float3& origin = vertices[merged[0].vertex];
+	Float3 e1 = subVectors(vertices[merged[1].vertex], origin);
+	Float3 e2 = subVectors(vertices[merged[2].vertex], origin);
+
+	// Solve the position of a point as 'origin + a * e1 + b * e2' using the dot products (Cramer's rule)
+	float d11 = dotProduct(e1, e1);
+	float d12 = dotProduct(e1, e2);
+	float d22 = dotProduct(e2, e2);
+	float denominator = d11 * d22 - d12 * d12;
+
+	if (fabs(denominator) <= COLLINEAR_EPSILON)
+		return false;
+
+	for (unsigned int i = 0; i < originals.size(); i++)
+	{
+		Float3 diff = subVectors(vertices[originals[i].vertex], origin);
+		float p1 = dotProduct(diff, e1);
+		float p2 = dotProduct(diff, e2);
+		float a = (p1 * d22 - p2 * d12) / denominator;
+		float b = (p2 * d11 - p1 * d12) / denominator;
+
+		Float2 expected = {
+			merged[0].tex.x + a * (merged[1].tex.x - merged[0].tex.x) + b * (merged[2].tex.x - merged[0].tex.x),
+			merged[0].tex.y + a * (merged[1].tex.y - merged[0].tex.y) + b * (merged[2].tex.y - merged[0].tex.y)
+		};
+
+		if (!SameTex(expected, originals[i].tex, epsilon))
+			return false;
+	}
+
+	return true;
+}
+
+// Without UVs, the corners must be in the order used by 'DrawScreen'. Returns false if they can't be.
+static bool MatchScale(vector<Corner>& corners, Plane& merged)
+{
+	float minU = corners[0].tex.x, maxU = corners[0].tex.x;
+	float minV = corners[0].tex.y, maxV = corners[0].tex.y;
+
+	for (unsigned int i = 1; i < corners.size(); i++)
+	{
+		minU = fmin(minU, corners[i].tex.x);
+		maxU = fmax(maxU, corners[i].tex.x);
+		minV = fmin(minV, corners[i].tex.y);
+		maxV = fmax(maxV, corners[i].tex.y);
+	}
+
+	// The texture must still start at the first corner
+	if (!IsInteger(minU) || !IsInteger(minV))
+		return false;
+
+	const Float2 pattern[PLANE_MAX_VERTICES] = {{minU, maxV}, {maxU, maxV}, {maxU, minV}, {minU, minV}};
+
+	// Find which corner must go first
+	for (unsigned int first = 0; first < corners.size(); first++)
+	{
+		bool match = true;
+
+		for (unsigned int i = 0; i < corners.size() && match; i++)
+		{
+			match = SameTex(corners[(first + i) % corners.size()].tex, pattern[i], UV_EPSILON);
+		}
+
+		if (match)
+		{
+			rotate(corners.begin(), corners.begin() + first, corners.end());
+			merged.Xscale = maxU - minU;
+			merged.Yscale = maxV - minV;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// Try to merge 'b' into 'a'. The result is put in 'merged'.
+static bool TryMerge(const Plane& a, const Plane& b, const vector<Float3>& vertices, const vector<Float2>& uvs, bool hasUVs, Plane& merged)
+{
+	if (a.Texture != b.Texture || a.Impassable != b.Impassable || a.TwoSided != b.TwoSided || a.Light != b.Light)
+		return false;
+
+	if (dotProduct(a.normal, b.normal) < 1 - NORMAL_EPSILON)
+		return false;
+
+	for (unsigned int i = 0; i < b.Count; i++)
+	{
+		if (fabs(dotProduct(a.normal, subVectors(vertices[b.Vertices[i]], a.centroid))) > COPLANAR_EPSILON)
+			return false;
+	}
+
+	// Find an edge that's shared. It goes in the opposite direction on the other plane.
+	unsigned int ea = 0, eb = 0;
+	bool shared = false;
+
+	for (ea = 0; ea < a.Count && !shared; ea++)
+	{
+		for (eb = 0; eb < b.Count && !shared; eb++)
+		{
+			shared = a.Vertices[ea] == b.Vertices[(eb + 1) % b.Count] && a.Vertices[(ea + 1) % a.Count] == b.Vertices[eb];
+		}
+	}
+
+	if (!shared)
+		return false;
+
+	ea--;
+	eb--;
+
+	Float2 texA[PLANE_MAX_VERTICES];
+	Float2 texB[PLANE_MAX_VERTICES];
+	Mapping(a, uvs, hasUVs, texA);
+	Mapping(b, uvs, hasUVs, texB);
+
+	// The texture must be continuous on the shared edge. Without UVs, it can be shifted by a whole texture.
+	Float2 offset = {texA[(ea + 1) % a.Count].x - texB[eb].x, texA[(ea + 1) % a.Count].y - texB[eb].y};
+	Float2 other = {texB[(eb + 1) % b.Count].x + offset.x, texB[(eb + 1) % b.Count].y + offset.y};
+
+	if (!SameTex(texA[ea], other, UV_EPSILON))
+		return false;
+
+	if (hasUVs ? !SameTex(offset, {0, 0}, UV_EPSILON) : !IsInteger(offset.x) || !IsInteger(offset.y))
+		return false;
+
+	// Go around 'a' starting after the shared edge, then around 'b' without the shared vertices
+	vector<Corner> originals;
+
+	for (unsigned int i = 0; i < a.Count; i++)
+	{
+		unsigned int k = (ea + 1 + i) % a.Count;
+		originals.push_back({a.Vertices[k], a.UVs[k], texA[k]});
+	}
+
+	for (unsigned int i = 2; i < b.Count; i++)
+	{
+		unsigned int k = (eb + i) % b.Count;
+		originals.push_back({b.Vertices[k], b.UVs[k], {texB[k].x + offset.x, texB[k].y + offset.y}});
+	}
+
+	vector<Corner> corners = originals;
+	RemoveCollinear(corners, vertices);
+
+	if (corners.size() > PLANE_MAX_VERTICES || !IsConvex(corners, vertices, a.normal))
+		return false;
+
+	if (!IsAffine(corners, originals, vertices, hasUVs ? UV_EPSILON : STRETCH_EPSILON))
+		return false;
+
+	merged = a;
+
+	if (!hasUVs && !MatchScale(corners, merged))
+		return false;
+
+	merged.Count = 0;
+	for (unsigned int i = 0; i < corners.size(); i++)
+	{
+		merged.AddVertex(corners[i].vertex, corners[i].uv);
+	}
+
+	merged.Process(vertices);
+
+	return true;
+}
+
+unsigned int MergePlanes(const vector<Float3>& vertices, const vector<Float2>& uvs, vector<Plane>& planes, bool hasUVs)
+{
+	// Planes that have an edge that goes from a vertex to another
+	map<pair<unsigned int, unsigned int>, vector<unsigned int>> edges;
+	vector<bool> removed(planes.size(), false);
+	unsigned int count = 0;
+
+	auto AddEdges = [&](unsigned int p)
+	{
+		for (unsigned int i = 0; i < planes[p].Count; i++)
+		{
+			edges[make_pair(planes[p].Vertices[i], planes[p].Vertices[(i + 1) % planes[p].Count])].push_back(p);
+		}
+	};
+
+	for (unsigned int i = 0; i < planes.size(); i++)
+	{
+		AddEdges(i);
+	}
+
+	// Merged planes can be merged again, so repeat until nothing changes
+	bool changed = true;
+	while (changed)
+	{
+		changed = false;
+
+		for (unsigned int a = 0; a < planes.size(); a++)
+		{
+			for (unsigned int i = 0; i < planes[a].Count && !removed[a]; )
+			{
+				bool merged = false;
+
+				// The neighbors have the same edge in the other direction
+				auto found = edges.find(make_pair(planes[a].Vertices[(i + 1) % planes[a].Count], planes[a].Vertices[i]));
+				for (unsigned int j = 0; found != edges.end() && j < found->second.size() && !merged; j++)
+				{
+					unsigned int b = found->second[j];
+					Plane result;
+
+					// The list may refer to planes that were removed or changed. 'TryMerge' checks the edges again.
+					if (b != a && !removed[b] && TryMerge(planes[a], planes[b], vertices, uvs, hasUVs, result))
+					{
+						planes[a] = result;
+						removed[b] = true;
+						count++;
+						merged = true;
+					}
+				}
+
+				if (merged)
+				{
+					// Start again with the edges of the merged plane
+					AddEdges(a);
+					changed = true;
+					i = 0;
+				}
+				else
+				{
+					i++;
+				}
+			}
+		}
+	}
+
+	vector<Plane> kept;
+	kept.reserve(planes.size() - count);
+
+	for (unsigned int i = 0; i < planes.size(); i++)
+	{
+		if (!removed[i])
+			kept.push_back(planes[i]);
+	}
+
+	planes.swap(kept);
+
+	return count;
+}
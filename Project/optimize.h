@@ -0,0 +1,39 @@
+// Copyright (C) 2020 Alexandre-Xavier Labonté-Lamoureux
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// optimize.h
+// Geometry optimizations that are done when a level is loaded
+
+#ifndef OPTIMIZE_H
+#define OPTIMIZE_H
+
+#include "plane.h"
+#include "vecmath.h"	/* Float2, Float3 */
+
+#include <vector>
+using namespace std;
+
+const float WELD_EPSILON = 0.01f;	// Vertices that are closer than this are the same vertex
+
+// Vertices that are within 'epsilon' of each other become a single vertex. Planes that lose
+// a corner because of it are removed, then unused vertices are removed. Returns the number of welded vertices.
+unsigned int WeldVertices(vector<Float3>& vertices, vector<Plane>& planes, float epsilon = WELD_EPSILON);
+
+// Adjacent coplanar planes that have the same texture, flags and light are merged into a bigger convex
+// polygon if the texture stays continuous. Planes without UVs ('hasUVs' is false) are mapped using
+// their scale, the same way as 'DrawScreen' does. Returns the number of planes that were removed.
+unsigned int MergePlanes(const vector<Float3>& vertices, const vector<Float2>& uvs, vector<Plane>& planes, bool hasUVs);
+
+#endif	// OPTIMIZE_H
@@ -0,0 +1,185 @@
+// Copyright (C) 2020 Alexandre-Xavier Labonté-Lamoureux
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// pacer.cpp
+// Keeps a steady frame rate
+
+#include "pacer.h"
+
+#include <time.h>		/* clock_nanosleep */
+#include <cerrno>		/* EINTR */
+#include <cmath>		/* sqrt, fabs, llround */
+#include <algorithm>	/* max */
+#include <iomanip>		/* setprecision */
+#include <iostream>
+#include <stdexcept>
+using namespace std;
+
+// Sleeps until a time of the steady clock. On Linux, it's the same clock as CLOCK_MONOTONIC.
+static void SleepUntil(chrono::steady_clock::time_point wake)
+{
+	chrono::nanoseconds since = wake.time_since_epoch();
+	timespec ts;
+	ts.tv_sec = chrono::duration_cast<chrono::seconds>(since).count();
+	ts.tv_nsec = (since - chrono::seconds(ts.tv_sec)).count();
+
+	// Signals interrupt the sleep, but the deadline stays the same
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR)
+	{
+		// Empty
+	}
+}
+
+Pacer::Pacer(double rate)
+{
+	SetRate(rate);
+}
+
+void Pacer::SetRate(double rate)
+{
+	if (rate < 0)
+	{
+		throw runtime_error("The frame rate can't be negative");
+	}
+
+	period_ = rate > 0 ? chrono::nanoseconds((long long)llround(1e9 / rate)) : chrono::nanoseconds(0);
+	deadline_ = chrono::steady_clock::now() + period_;
+}
+
+double Pacer::Rate() const
+{
+	return period_.count() > 0 ? 1e9 / period_.count() : 0;
+}
+
+void Pacer::SetLog(const string& path)
+{
+	log_.open(path);
+
+	if (!log_.is_open())
+	{
+		throw runtime_error("Could not open '" + path + "'");
+	}
+
+	log_ << "frame interval_ms late" << endl;
+}
+
+void Pacer::Wait()
+{
+	bool late = false;
+
+	if (period_.count() > 0)
+	{
+		auto now = chrono::steady_clock::now();
+
+		if (!started_)
+		{
+			// The first frame starts the cadence
+			deadline_ = now;
+		}
+		else if (now >= deadline_)
+		{
+			// Start again from now, instead of rushing the next frames to catch up
+			late = true;
+			late_++;
+			deadline_ = now;
+		}
+		else
+		{
+			if (now < deadline_ - PACER_SPIN)
+				SleepUntil(deadline_ - PACER_SPIN);
+
+			while (chrono::steady_clock::now() < deadline_)
+			{
+				// Spin
+			}
+		}
+
+		deadline_ += period_;
+	}
+
+	auto now = chrono::steady_clock::now();
+
+	if (started_)
+	{
+		Measure(now);
+
+		if (log_.is_open())
+			log_ << frames_ << ' ' << chrono::duration<double, milli>(now - last_).count() << ' ' << late << '\n';
+	}
+
+	started_ = true;
+	last_ = now;
+}
+
+void Pacer::Measure(chrono::steady_clock::time_point now)
+{
+	double interval = chrono::duration<double, milli>(now - last_).count();
+	double period = chrono::duration<double, milli>(period_).count();
+
+	if (frames_ == 0 || interval < min_)
+		min_ = interval;
+	if (frames_ == 0 || interval > max_)
+		max_ = interval;
+
+	frames_++;
+	sum_ += interval;
+	squares_ += interval * interval;
+
+	if (period > 0)
+		deviation_ += fabs(interval - period);
+}
+
+unsigned long Pacer::Frames() const
+{
+	return frames_;
+}
+
+unsigned int Pacer::Late() const
+{
+	return late_;
+}
+
+double Pacer::Average() const
+{
+	return frames_ > 0 ? sum_ / frames_ : 0;
+}
+
+double Pacer::Jitter() const
+{
+	if (frames_ == 0)
+		return 0;
+
+	double average = sum_ / frames_;
+	return sqrt(max(0.0, squares_ / frames_ - average * average));
+}
+
+void Pacer::PrintStats() const
+{
+	if (frames_ == 0)
+		return;
+
+	cout << fixed << setprecision(3);
+
+	cout << "Pacing: " << frames_ << " frames of " << Average() << " ms on average (" << min_ << " to " << max_ << " ms), jitter of " << Jitter() << " ms." << endl;
+
+	if (period_.count() > 0)
+	{
+		cout << "Pacing: target of " << chrono::duration<double, milli>(period_).count() << " ms (" << Rate() << " Hz), "
+			<< deviation_ / frames_ << " ms away from it on average, " << late_ << " frames were late." << endl;
+	}
+
+	cout.unsetf(ios::fixed);
+	cout << setprecision(6);
+}
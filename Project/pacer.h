@@ -0,0 +1,71 @@
+// Copyright (C) 2020 Alexandre-Xavier Labonté-Lamoureux
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// pacer.h
+// Keeps a steady frame rate. Each frame has an absolute deadline on the monotonic clock, so the
+// rounding errors don't add up. The thread sleeps until just before the deadline, then spins for the rest.
+// The time between the frames is measured so that the jitter can be checked.
+
+#ifndef PACER_H
+#define PACER_H
+
+#include <chrono>
+#include <fstream>
+#include <string>
+using namespace std;
+
+const chrono::microseconds PACER_SPIN(500);	// The scheduler can wake up a thread that late
+
+class Pacer
+{
+private:
+	chrono::nanoseconds period_;	// 0 if there's no limit
+	chrono::steady_clock::time_point deadline_;	// End of the current frame
+	chrono::steady_clock::time_point last_;	// When the current frame started
+	bool started_ = false;	// The first frame has no interval and no deadline
+	ofstream log_;
+
+	// Statistics of the time between the frames, in ms
+	unsigned long frames_ = 0;	// Intervals that were measured
+	double sum_ = 0;
+	double squares_ = 0;
+	double deviation_ = 0;	// Sum of the distance to the period
+	double min_ = 0;
+	double max_ = 0;
+	unsigned int late_ = 0;	// Frames that ended after their deadline
+
+	void Measure(chrono::steady_clock::time_point now);
+
+public:
+	explicit Pacer(double rate = 0);	// Frames per second, 0 if there's no limit
+
+	void SetRate(double rate);
+	double Rate() const;
+
+	// Writes a line for every frame with the time since the previous one
+	void SetLog(const string& path);
+
+	// Waits until the deadline of the current frame, then starts the next one. Without a limit, it only measures.
+	// A frame that is late doesn't make the next ones shorter.
+	void Wait();
+
+	unsigned long Frames() const;
+	unsigned int Late() const;
+	double Average() const;	// ms between the frames
+	double Jitter() const;	// Standard deviation of the time between the frames, in ms
+	void PrintStats() const;
+};
+
+#endif	// PACER_H
@@ -42,31 +42,34 @@ float CapHeight(float point, float min, float max)
 }
 
 // Test if the player is inside the polygon or touching one of its edges
-bool TouchesPlane(const Player* play, const Plane* p)
+bool TouchesPlane(const Player* play, const Plane* p, const vector<Float3>& vertices)
 {
+	Float3 corners[PLANE_MAX_VERTICES];
+	unsigned int count = p->Corners(vertices, corners);
+
 	// Is the player inside the polygon?
-	if (pointInPoly(play->PosX(), play->PosY(), p->Vertices))
+	if (pointInPoly(play->PosX(), play->PosY(), corners, count))
 		return true;
 
 	// Is the player touching one of the polygon's edges?
-	for (unsigned int i = 0, j = p->Vertices.size() - 1; i < p->Vertices.size(); j = i++)
-		if (lineCircle(p->Vertices[i].x, p->Vertices[i].y, p->Vertices[j].x, p->Vertices[j].y,play->PosX(), play->PosY(), play->Radius()))
+	for (unsigned int i = 0, j = count - 1; i < count; j = i++)
+		if (lineCircle(corners[i].x, corners[i].y, corners[j].x, corners[j].y,play->PosX(), play->PosY(), play->Radius()))
 			return true;
 
 	return false;
 }
 
 // Get every plane toucehd by a player
-vector<Plane*> TouchedPlanes(const Player* play, const Level* lvl)
+vector<const Plane*> TouchedPlanes(const Player* play, const Level* lvl)
 {
-	vector<Plane*> touched;
+	vector<const Plane*> touched;
 
 	// List of potential planes that can be touched. Others were discarded.
-	vector<Plane*> potential = lvl->getPlanesForBox(play->pos_.x, play->pos_.y, play->Radius());
+	vector<const Plane*> potential = lvl->getPlanesForBox(play->pos_.x, play->pos_.y, play->Radius());
 
 	// Make a the list of planes that were toucehd
 	for (unsigned int i = 0; i < potential.size(); i++)
-		if (TouchesPlane(play, potential[i]))		// Player touches the polygon
+		if (TouchesPlane(play, potential[i], lvl->vertices))		// Player touches the polygon
 			touched.push_back(potential[i]);
 
 	return touched;
@@ -78,7 +81,7 @@ bool AdjustPlayerToFloor(Player* play, Level* lvl)
 	float NewHeight = numeric_limits<float>::lowest();
 	bool ChangeHeight = false;	// Note: Making this true will allow the player to fall in the void
 
-	vector<Plane*> touched = TouchedPlanes(play, lvl);
+	vector<const Plane*> touched = TouchedPlanes(play, lvl);
 
 	for (unsigned int i = 0; i < touched.size(); i++)
 	{
@@ -127,7 +130,7 @@ bool BlocksPlayer(const Player* play, float min, float max)
 }
 
 // Returns true of the player touches obstructing walls
-bool PlayerTouchesWalls(const Player* play, const vector<Plane*>& touched)
+bool PlayerTouchesWalls(const Player* play, const vector<const Plane*>& touched)
 {
 	for (unsigned int i = 0; i < touched.size(); i++)
 		if (!touched[i]->CanWalk() && BlocksPlayer(play, touched[i]->Min(), touched[i]->Max()))
@@ -137,9 +140,9 @@ bool PlayerTouchesWalls(const Player* play, const vector<Plane*>& touched)
 }
 
 // Returns a list of obstructing walls
-vector<Plane*> PlayerTouchedWallsList(const Player* play, const vector<Plane*>& touched)
+vector<const Plane*> PlayerTouchedWallsList(const Player* play, const vector<const Plane*>& touched)
 {
-	vector<Plane*> obstructors;
+	vector<const Plane*> obstructors;
 
 	for (unsigned int i = 0; i < touched.size(); i++)
 		if (!touched[i]->CanWalk() && BlocksPlayer(play, touched[i]->Min(), touched[i]->Max()))
@@ -229,20 +232,20 @@ Float2 MoveOnCollision(const Float3& origin, const Float3& target, const Player*
 	if (PlayerTouchesWalls(play, TouchedPlanes(play, lvl)))
 	{
 		// Get the list of touched walls
-		const vector<Plane*> touched = PlayerTouchedWallsList(play, TouchedPlanes(play, lvl));
+		const vector<const Plane*> touched = PlayerTouchedWallsList(play, TouchedPlanes(play, lvl));
 
-		Player* dummy = new Player();	// Used for simulations
-		dummy->pos_.z = play->pos_.z;	// The "dummy" must be at the same height as the player
+		Player dummy;	// Used for simulations
+		dummy.pos_.z = play->pos_.z;	// The "dummy" must be at the same height as the player
 
 		// Try to move slide the player at least three times
 		for (unsigned int i = 0; i < touched.size() && i < 3; i++)
 		{
 			Float2 myNewPos = SlideOnCollision(origin, target, touched[i]);
 
-			dummy->pos_.x = myNewPos.x;
-			dummy->pos_.y = myNewPos.y;
+			dummy.pos_.x = myNewPos.x;
+			dummy.pos_.y = myNewPos.y;
 
-			if (PlayerTouchesWalls(dummy, TouchedPlanes(dummy, lvl)))
+			if (PlayerTouchesWalls(&dummy, TouchedPlanes(&dummy, lvl)))
 			{
 				// Didn't work, try again...
 				continue;
@@ -273,7 +276,7 @@ void Hitscan(Level* lvl, Player* play, const vector<Player*>& players)
 	const float THRESHOLD = 0.5f;
 
 	Float3 wallHitPoint;
-	Plane* planeHitPoint = nullptr;
+	const Plane* planeHitPoint = nullptr;
 	float wallDist = numeric_limits<float>::max();
 
 	// Check for polygons that are hit.
@@ -282,24 +285,25 @@ void Hitscan(Level* lvl, Player* play, const vector<Player*>& players)
 		// Get the point where the player is looking at and throw a ray
 		//http://www.opengl-tutorial.org/beginners-tutorials/tutorial-6-keyboard-and-mouse/
 		Float3 aim = {play->AimX(), play->AimY(), play->AimZ()};
-		Float3 f = RayIntersect(aim, {play->PosX(), play->PosY(), play->CamZ()}, lvl->planes[i]->normal, lvl->planes[i]->centroid);
+		Float3 f = RayIntersect(aim, {play->PosX(), play->PosY(), play->CamZ()}, lvl->planes[i].normal, lvl->planes[i].centroid);
 
 		// Check if point is valid
 		if (f.z != numeric_limits<float>::quiet_NaN())
 		{
-			vector<Float3> verts = lvl->planes[i]->Vertices;
+			Float3 verts[PLANE_MAX_VERTICES];
+			unsigned int count = lvl->planes[i].Corners(lvl->vertices, verts);
 
 			// Check if the point is inside the polygon (because a plane is infinite)
 			bool test = false;
-			if (lvl->planes[i]->normal.z >= THRESHOLD || lvl->planes[i]->normal.z <= -THRESHOLD)
-				test = pointInPoly(f.x, f.y, verts, 0, 1);	// xOy
-			else if (lvl->planes[i]->normal.x >= THRESHOLD || lvl->planes[i]->normal.x <= -THRESHOLD)
-				test = pointInPoly(f.y, f.z, verts, 1, 2);	// yOz
-			else if (lvl->planes[i]->normal.y >= THRESHOLD || lvl->planes[i]->normal.y <= -THRESHOLD)
-				test = pointInPoly(f.z, f.x, verts, 2, 0);	// zOx
+			if (lvl->planes[i].normal.z >= THRESHOLD || lvl->planes[i].normal.z <= -THRESHOLD)
+				test = pointInPoly(f.x, f.y, verts, count, 0, 1);	// xOy
+			else if (lvl->planes[i].normal.x >= THRESHOLD || lvl->planes[i].normal.x <= -THRESHOLD)
+				test = pointInPoly(f.y, f.z, verts, count, 1, 2);	// yOz
+			else if (lvl->planes[i].normal.y >= THRESHOLD || lvl->planes[i].normal.y <= -THRESHOLD)
+				test = pointInPoly(f.z, f.x, verts, count, 2, 0);	// zOx
 			else
 				throw runtime_error("Caught a polygon with the following normal:\n" +
-					to_string(lvl->planes[i]->normal.x) + ", " + to_string(lvl->planes[i]->normal.y) + ", " + to_string(lvl->planes[i]->normal.z));
+					to_string(lvl->planes[i].normal.x) + ", " + to_string(lvl->planes[i].normal.y) + ", " + to_string(lvl->planes[i].normal.z));
 
 			if (test)
 			{
@@ -316,13 +320,13 @@ void Hitscan(Level* lvl, Player* play, const vector<Player*>& players)
 						if (dist < wallDist)
 						{
 							wallHitPoint = f;	// Set hit position
-							planeHitPoint = lvl->planes[i];	// Set wall that was hit
+							planeHitPoint = &lvl->planes[i];	// Set wall that was hit
 						}
 					}
 					else
 					{
 						wallHitPoint = f;	// Set hit position
-						planeHitPoint = lvl->planes[i];	// Set wall that was hit
+						planeHitPoint = &lvl->planes[i];	// Set wall that was hit
 						wallDist = dist;	// Set distance of hit
 					}
 				}
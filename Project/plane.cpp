@@ -21,18 +21,59 @@
 
 #include <cmath>
 #include <limits>
+#include <string>
+#include <stdexcept>
 
 using namespace std;
 
+Plane::Plane(): Count(0), Impassable(true), TwoSided(false)
+{
+	// Empty
+}
+
+void Plane::AddVertex(unsigned int vertex, unsigned int uv)
+{
+	if (Count >= PLANE_MAX_VERTICES)
+		throw runtime_error("Planes can't have more than " + to_string(PLANE_MAX_VERTICES) + " vertices");
+
+	Vertices[Count] = vertex;
+	UVs[Count] = uv;
+	Count++;
+}
+
+void Plane::RemoveVertex(unsigned int index)
+{
+	for (unsigned int i = index + 1; i < Count; i++)
+	{
+		Vertices[i - 1] = Vertices[i];
+		UVs[i - 1] = UVs[i];
+	}
+
+	Count--;
+}
+
+unsigned int Plane::Corners(const vector<Float3>& vertices, Float3* corners) const
+{
+	for (unsigned int i = 0; i < Count; i++)
+	{
+		corners[i] = vertices[Vertices[i]];
+	}
+
+	return Count;
+}
+
 // Process a plane
-void Plane::Process()
+void Plane::Process(const vector<Float3>& vertices)
 {
-	normal = ComputeNormal(Vertices);
-	centroid = ComputeAverage(Vertices);
-	SetBox();
+	Float3 corners[PLANE_MAX_VERTICES];
+	unsigned int count = Corners(vertices, corners);
+
+	normal = ComputeNormal(corners, count);
+	centroid = ComputeAverage(corners, count);
+	SetBox(corners, count);
 }
 
-void Plane::SetBox()
+void Plane::SetBox(const Float3* corners, unsigned int count)
 {
 	max.x = -numeric_limits<float>::max();
 	max.y = -numeric_limits<float>::max();
@@ -42,25 +83,25 @@ void Plane::SetBox()
 	min.y = numeric_limits<float>::max();
 	min.z = numeric_limits<float>::max();
 
-	for (unsigned int i = 0; i < Vertices.size(); i++)
+	for (unsigned int i = 0; i < count; i++)
 	{
 		// x
-		if (Vertices[i].x < min.x)
-			min.x = Vertices[i].x;
-		if (Vertices[i].x > max.x)
-			max.x = Vertices[i].x;
+		if (corners[i].x < min.x)
+			min.x = corners[i].x;
+		if (corners[i].x > max.x)
+			max.x = corners[i].x;
 
 		// y
-		if (Vertices[i].y < min.y)
-			min.y = Vertices[i].y;
-		if (Vertices[i].y > max.y)
-			max.y = Vertices[i].y;
+		if (corners[i].y < min.y)
+			min.y = corners[i].y;
+		if (corners[i].y > max.y)
+			max.y = corners[i].y;
 
 		// z
-		if (Vertices[i].z < min.z)
-			min.z = Vertices[i].z;
-		if (Vertices[i].z > max.z)
-			max.z = Vertices[i].z;
+		if (corners[i].z < min.z)
+			min.z = corners[i].z;
+		if (corners[i].z > max.z)
+			max.z = corners[i].z;
 	}
 }
 
@@ -102,6 +143,11 @@ float Plane::Min() const
 	return min.z;
 }
 
+float Plane::Radius() const
+{
+	return sqrt(pow(max.x - min.x, 2) + pow(max.y - min.y, 2) + pow(max.z - min.z, 2)) / 2;
+}
+
 float Plane::Angle() const
 {
 	// Return an angle that can be used for sliding if this plane cannot be entered
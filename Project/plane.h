@@ -19,45 +19,52 @@
 #ifndef PLANE_H
 #define PLANE_H
 
-#include "texture.h"
 #include "vecmath.h"
 
-#include <string>
 #include <vector>
 
 using namespace std;
 
+const unsigned int PLANE_MAX_VERTICES = 4;	// Planes are triangles or quads
+const unsigned short NO_TEXTURE = 0xFFFF;	// Texture ID of invisible planes
+
+// Planes don't own their vertices. They hold indices in the level's shared arrays.
 class Plane
 {
 public:
-	string Texture;
-	bool Impassable = true;
-	bool TwoSided = false;
-	vector<Float3> Vertices;
-	vector<Float2> UVs;
+	unsigned int Vertices[PLANE_MAX_VERTICES];	// Indices in 'Level::vertices'
+	unsigned int UVs[PLANE_MAX_VERTICES];	// Indices in 'Level::uvs' (only used if the level has UVs)
+	unsigned short Texture = NO_TEXTURE;	// Index in the level's texture table
+	unsigned char Count : 3;	// Number of vertices
+	unsigned char Impassable : 1;
+	unsigned char TwoSided : 1;
 	float Xscale = 0;
 	float Yscale = 0;
-	float Xoff = 0;
-	float Yoff = 0;
 	float Light = 1;	// Must be between 0 (dark) and 1 (full bright)
 
 	Float3 normal;
 	Float3 centroid;
-	vector<Plane*> Neighbors;	// List of adjacent planes
 
 private:
 	Float3 max;		// Maximal coordinates
 	Float3 min;		// Minimal coordinates
 
 public:
+	Plane();
+
+	void AddVertex(unsigned int vertex, unsigned int uv = 0);
+	void RemoveVertex(unsigned int index);
+	unsigned int Corners(const vector<Float3>& vertices, Float3* corners) const;	// Copy the vertices to 'corners', returns the count
+
 	float Max() const;
 	float Min() const;
+	float Radius() const;	// Radius of a sphere around the centroid that contains the plane
 
 	float Angle() const;
 
-	void Process();		// Find centroid, find normal...
+	void Process(const vector<Float3>& vertices);	// Find centroid, find normal...
 
-	void SetBox();
+	void SetBox(const Float3* corners, unsigned int count);
 	bool InBox2D(float x, float y, float radius) const;
 
 	bool CanWalk() const;
@@ -26,6 +26,7 @@
 #include <limits>		/* numeric_limits */
 #include <string>		/* to_string() */
 #include <cstring>		/* memcpy */
+#include <algorithm>	/* copy */
 
 using namespace std;
 
@@ -41,13 +42,16 @@ Player::Player()
 	// Add the sprites to the cache from their filename
 	for (unsigned int i = 0; i < sprites_.size(); i++)
 	{
-		Cache::Instance()->Add(sprites_[i], false);
+		Cache::Instance()->Acquire(sprites_[i], false);
 	}
 }
 
 Player::~Player()
 {
-	// Empty
+	for (unsigned int i = 0; i < sprites_.size(); i++)
+	{
+		Cache::Instance()->Release(sprites_[i]);
+	}
 }
 
 void Player::Reset()
@@ -85,20 +89,6 @@ void Player::LateralMove(int Thrust)
 	pos_.y += ((float)Thrust / 64) * sin(LateralAngle);
 }
 
-// Encodes a player's data to a buffer for network usage
-vector<unsigned char> Player::CmdToNet() const
-{
-	// Serialize the command
-	return Cmd.Serialize();
-}
-
-// Decodes a player's data from a buffer and write to command
-void Player::NetToCmd(vector<unsigned char> v)
-{
-	// Deserialize the command
-	Cmd.Deserialize(v);
-}
-
 void Player::ExecuteTick()
 {
 	// TODO: This should be moved elsewhere
@@ -117,6 +107,50 @@ void Player::ExecuteTick()
 	Cmd.Reset();
 }
 
+void Player::Save(PlayerState& state) const
+{
+	state.pos = pos_;
+	state.mom = mom_;
+	state.plane = plane;
+	state.Angle = Angle;
+	state.VerticalAim = VerticalAim;
+	state.MoX = MoX;
+	state.MoY = MoY;
+	state.MoZ = MoZ;
+	state.AirTime = AirTime;
+	state.ShouldFire = ShouldFire;
+	state.TimeSinceLastShot = TimeSinceLastShot;
+	copy(OwnedWeapons, OwnedWeapons + MAXOWNEDWEAPONS, state.OwnedWeapons);
+	state.Ammo = Ammo;
+	state.Shells = Shells;
+	state.Rockets = Rockets;
+	state.Cells = Cells;
+	state.Kills = Kills;
+	state.Deaths = Deaths;
+}
+
+void Player::Restore(const PlayerState& state)
+{
+	pos_ = state.pos;
+	mom_ = state.mom;
+	plane = state.plane;
+	Angle = state.Angle;
+	VerticalAim = state.VerticalAim;
+	MoX = state.MoX;
+	MoY = state.MoY;
+	MoZ = state.MoZ;
+	AirTime = state.AirTime;
+	ShouldFire = state.ShouldFire;
+	TimeSinceLastShot = state.TimeSinceLastShot;
+	copy(state.OwnedWeapons, state.OwnedWeapons + MAXOWNEDWEAPONS, OwnedWeapons);
+	Ammo = state.Ammo;
+	Shells = state.Shells;
+	Rockets = state.Rockets;
+	Cells = state.Cells;
+	Kills = state.Kills;
+	Deaths = state.Deaths;
+}
+
 float Player::GetRadianAngle(short Angle) const
 {
 	return Angle * M_PI * 2 / 32768;
@@ -219,6 +253,44 @@ float Player::AimZ() const
 	return sin(VerticalAim);
 }
 
+void Player::Remember()
+{
+	Actor::Remember();
+	prevAngle_ = Angle;
+	prevAim_ = VerticalAim;
+}
+
+short Player::InterpolateAngle(float alpha) const
+{
+	if (!remembered_)
+		return Angle;
+
+	// A full turn is 32768. The difference is brought back to half a turn at most, so the view turns the short way.
+	int turn = Angle - prevAngle_;
+
+	if (turn >= 16384)
+		turn -= 32768;
+	else if (turn < -16384)
+		turn += 32768;
+
+	return prevAngle_ + (short)lround(turn * alpha);
+}
+
+float Player::InterpolateAim(float alpha) const
+{
+	if (!remembered_)
+		return VerticalAim;
+
+	return prevAim_ + (VerticalAim - prevAim_) * alpha;
+}
+
+Float3 Player::InterpolateCam(float alpha) const
+{
+	Float3 cam = Interpolate(alpha);
+	cam.z += ViewZ;
+	return cam;
+}
+
 Texture* Player::GetSprite(Float3 CamPos) const
 {
 	// Get the angle between the player thing and the camera
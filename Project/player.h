@@ -31,6 +31,23 @@
 
 using namespace std;
 
+// Everything about a player that changes while the game runs
+struct PlayerState
+{
+	Float3 pos;
+	Float3 mom;
+	Plane* plane;
+	short Angle;
+	float VerticalAim;
+	char MoX, MoY, MoZ;
+	int AirTime;
+	bool ShouldFire;
+	int TimeSinceLastShot;
+	bool OwnedWeapons[MAXOWNEDWEAPONS];
+	short Ammo, Shells, Rockets, Cells;
+	int Kills, Deaths;
+};
+
 class Player: public Actor
 {
 public:
@@ -63,7 +80,7 @@ public:
 	short Cells = 0;
 
 	Player(); // We need a constructor for the weapons array
-	~Player();	// Deletes the sprite
+	~Player();	// Releases the sprites
 	void Reset();
 	float PosX() const;
 	float PosY() const;
@@ -84,9 +101,9 @@ public:
 	// Executes the player's actions
 	void ExecuteTick();
 
-	// Command transfer
-	vector<unsigned char> CmdToNet() const;
-	void NetToCmd(vector<unsigned char> v);
+	// Copy the state of the player or go back to it. The command is not part of it.
+	void Save(PlayerState& state) const;
+	void Restore(const PlayerState& state);
 
 	float GetRadianAngle(short Angle) const;
 	float Radius() const;
@@ -107,7 +124,17 @@ public:
 	float AimY() const;
 	float AimZ() const;
 
+	// The view between the last two tics
+	void Remember();
+	short InterpolateAngle(float alpha) const;
+	float InterpolateAim(float alpha) const;
+	Float3 InterpolateCam(float alpha) const;
+
 	// TODO: Add Pos() and Aim(). Aim is a normalized vector.
+
+private:
+	short prevAngle_ = 8192;	// View before the last tic
+	float prevAim_ = 0;
 };
 
 struct SpawnSpot
@@ -20,7 +20,8 @@
 #include "random.h"
 
 // Defined here in order to avoid "warning: 'Index' defined but not used"
-static unsigned short Index_ = 0;
+// Each thread has its own, so that games can run on several threads at once.
+static thread_local unsigned short Index_ = 0;
 
 // Return the next "random" number
 int Rand()
@@ -0,0 +1,191 @@
+// Copyright (C) 2020 Alexandre-Xavier Labonté-Lamoureux
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// replay.cpp
+// Plays a list of demos without a window, on several threads, to check that they still play the same way
+
+#include "replay.h"
+#include "command.h"	/* FindArgumentPosition, FindArgumentParameter */
+#include "demo.h"
+#include "world.h"
+#include "archive.h"	/* Resources */
+#include "cache.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>		/* EXIT_FAILURE, EXIT_SUCCESS */
+#include <fstream>
+#include <iomanip>		/* setw */
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+
+struct ReplayResult
+{
+	string error;	// Empty if the demo could be played
+	unsigned int tics = 0;
+	unsigned int checksum = 0;	// State after the last tic
+	double time = 0;	// ms
+	double slowest = 0;	// ms
+	unsigned int slowestTic = 0;
+	int desync = -1;	// First tic that's different from the checksums of the demo, -1 if there's none
+};
+
+static void replayDemo(const string& name, float scale, ReplayResult& result)
+{
+	auto start = chrono::steady_clock::now();
+
+	DemoReader demo;
+	demo.Open(name);
+
+	World world(demo.Level(), scale, demo.Players(), demo.Seed(), demo.Optimized());
+	vector<Ticcmd> cmds(demo.Players());
+
+	unsigned int sum = 0;
+
+	while (demo.Read(cmds.data()))
+	{
+		auto before = chrono::steady_clock::now();
+		world.Tick(cmds.data());
+		chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - before;
+
+		if (elapsed.count() > result.slowest)
+		{
+			result.slowest = elapsed.count();
+			result.slowestTic = result.tics;
+		}
+
+		if (result.desync < 0 && demo.Checksum(result.tics, sum) && sum != world.Checksum())
+			result.desync = result.tics;
+
+		result.tics++;
+	}
+
+	result.checksum = world.Checksum();
+	result.time = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+int replay(int argc, const char* argv[])
+{
+	string ListName = FindArgumentParameter(argc, argv, "-replay");
+	string ResultsName = FindArgumentParameter(argc, argv, "-results", "replay.txt");
+	unsigned int threads = stoul(FindArgumentParameter(argc, argv, "-threads", to_string(max(thread::hardware_concurrency(), 1u))));
+	float scale = stof(FindArgumentParameter(argc, argv, "-scale", "1.0"));
+
+	// One demo per line
+	ifstream list(ListName);
+	if (!list.is_open())
+	{
+		throw runtime_error("Could not open the list of demos '" + ListName + "'");
+	}
+
+	vector<string> demos;
+	string line;
+	while (getline(list, line))
+	{
+		if (!line.empty())
+			demos.push_back(line);
+	}
+
+	// Only the size of the textures matters for the game
+	Cache::Instance()->SetHeadless();
+
+	string ArchiveName = FindArgumentParameter(argc, argv, "-archive", "meshglide.mgpk");
+	if (!Resources::Instance()->Mount(ArchiveName) && FindArgumentPosition(argc, argv, "-archive") > 0)
+	{
+		throw runtime_error("Could not open archive '" + ArchiveName + "'");
+	}
+
+	cout << "Replaying " << demos.size() << " demos on " << threads << " threads." << endl;
+
+	// Each thread takes the next demo that nobody took
+	vector<ReplayResult> results(demos.size());
+	atomic<unsigned int> next{0};
+	auto start = chrono::steady_clock::now();
+
+	auto worker = [&]()
+	{
+		for (unsigned int i = next++; i < demos.size(); i = next++)
+		{
+			try
+			{
+				replayDemo(demos[i], scale, results[i]);
+			}
+			catch (const exception& e)
+			{
+				results[i].error = e.what();
+			}
+		}
+	};
+
+	vector<thread*> workers;
+	for (unsigned int i = 0; i < threads; i++)
+		workers.push_back(new thread(worker));
+
+	for (unsigned int i = 0; i < workers.size(); i++)
+	{
+		workers[i]->join();
+		delete workers[i];
+	}
+
+	double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+	// Demo, tics, checksum, time (ms), slowest tic and its time (ms), first tic that desyncs
+	ofstream out(ResultsName);
+	if (!out.is_open())
+	{
+		throw runtime_error("Could not open file '" + ResultsName + "' to write");
+	}
+
+	unsigned int failures = 0;
+	unsigned long tics = 0;
+	out << fixed << setprecision(3);
+
+	for (unsigned int i = 0; i < demos.size(); i++)
+	{
+		const ReplayResult& r = results[i];
+		out << demos[i];
+
+		if (!r.error.empty())
+		{
+			out << "\terror\t" << r.error << '\n';
+			failures++;
+			continue;
+		}
+
+		out << '\t' << r.tics << '\t' << r.checksum << '\t' << r.time << '\t' << r.slowestTic << '\t' << r.slowest << '\t';
+
+		if (r.desync >= 0)
+		{
+			out << "desync " << r.desync << '\n';
+			failures++;
+		}
+		else
+		{
+			out << "ok\n";
+		}
+
+		tics += r.tics;
+	}
+
+	cout << "Replayed " << tics << " tics in " << elapsed << " s. " << failures << " demos failed or desynced. Results written to '" << ResultsName << "'." << endl;
+
+	Resources::DestroyInstance();
+
+	return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
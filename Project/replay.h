@@ -0,0 +1,25 @@
+// Copyright (C) 2020 Alexandre-Xavier Labonté-Lamoureux
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// replay.h
+// Plays a list of demos without a window, on several threads, to check that they still play the same way
+
+#ifndef REPLAY_H
+#define REPLAY_H
+
+// Each demo is played at full speed in its own level. The results are written in the file given by '-results'.
+int replay(int argc, const char* argv[]);
+
+#endif	// REPLAY_H
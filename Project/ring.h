@@ -0,0 +1,70 @@
+// Copyright (C) 2020 Alexandre-Xavier Labonté-Lamoureux
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// ring.h
+// Lock-free ring buffer for one producer thread and one consumer thread.
+// Slots are filled and read in place, so the memory they own is reused.
+
+#ifndef RING_H
+#define RING_H
+
+#include <atomic>
+using namespace std;
+
+template <typename T, unsigned int N>
+class Ring
+{
+private:
+	static_assert(N > 0 && (N & (N - 1)) == 0, "The size of a ring must be a power of two");
+
+	T slots_[N];
+	atomic<unsigned int> head_{0};	// Next slot to read. Only the consumer writes it.
+	atomic<unsigned int> tail_{0};	// Next slot to write. Only the producer writes it.
+
+public:
+	// Producer. Returns the slot to fill, or nullptr if the ring is full. 'Push' makes it visible.
+	T* Back()
+	{
+		unsigned int tail = tail_.load(memory_order_relaxed);
+
+		if (tail - head_.load(memory_order_acquire) == N)
+			return nullptr;
+
+		return &slots_[tail % N];
+	}
+
+	void Push()
+	{
+		tail_.store(tail_.load(memory_order_relaxed) + 1, memory_order_release);
+	}
+
+	// Consumer. Returns the oldest slot, or nullptr if the ring is empty. 'Pop' gives it back to the producer.
+	T* Front()
+	{
+		unsigned int head = head_.load(memory_order_relaxed);
+
+		if (head == tail_.load(memory_order_acquire))
+			return nullptr;
+
+		return &slots_[head % N];
+	}
+
+	void Pop()
+	{
+		head_.store(head_.load(memory_order_relaxed) + 1, memory_order_release);
+	}
+};
+
+#endif	// RING_H
@@ -0,0 +1,338 @@
+// Copyright (C) 2020 Alexandre-Xavier Labonté-Lamoureux
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// shmem.cpp
+// Transport for the players that are on the same computer
+
+#include "shmem.h"
+
+#include <sys/mman.h>	/* shm_open, mmap */
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>	/* ftruncate, close */
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>	/* memcpy, strerror */
+#include <cerrno>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+using namespace std;
+
+static_assert(ATOMIC_INT_LOCK_FREE == 2, "The shared memory needs atomics that don't use locks");
+static_assert((SHM_QUEUE_SIZE & (SHM_QUEUE_SIZE - 1)) == 0, "The size of a queue must be a power of two");
+
+const uint32_t SHM_MAGIC = 0x4D475348;	// Set once the server initialized the segment
+
+// Messages are stored one after the other with their size in front. One process writes, the other reads.
+struct ShmQueue
+{
+	alignas(64) atomic<uint32_t> head;	// Bytes that were read
+	alignas(64) atomic<uint32_t> tail;	// Bytes that were written
+	alignas(64) unsigned char data[SHM_QUEUE_SIZE];
+};
+
+struct ShmSegment
+{
+	atomic<uint32_t> magic;
+	atomic<uint32_t> clients;
+	atomic<uint32_t> joined;	// Clients that took a player number
+	atomic<uint32_t> started;	// The settings were written
+	uint32_t infoSize;
+	char info[SHM_INFO_SIZE];
+	ShmQueue toServer[SHM_MAX_CLIENTS];
+	ShmQueue toClient[SHM_MAX_CLIENTS];
+};
+
+// Copies that go around the end of the queue
+static void Write(ShmQueue& queue, uint32_t position, const void* data, size_t size)
+{
+	size_t offset = position % SHM_QUEUE_SIZE;
+	size_t first = min(size, SHM_QUEUE_SIZE - offset);
+	memcpy(queue.data + offset, data, first);
+	memcpy(queue.data, static_cast<const unsigned char*>(data) + first, size - first);
+}
+
+static void Read(const ShmQueue& queue, uint32_t position, void* data, size_t size)
+{
+	size_t offset = position % SHM_QUEUE_SIZE;
+	size_t first = min(size, SHM_QUEUE_SIZE - offset);
+	memcpy(data, queue.data + offset, first);
+	memcpy(static_cast<unsigned char*>(data) + first, queue.data, size - first);
+}
+
+SharedMemory::SharedMemory()
+{
+	// Empty
+}
+
+SharedMemory::~SharedMemory()
+{
+	if (segment_)
+		munmap(segment_, sizeof(ShmSegment));
+}
+
+bool SharedMemory::Map(bool create)
+{
+	int fd = shm_open(name_.c_str(), create ? O_CREAT | O_RDWR : O_RDWR, 0600);
+
+	if (fd < 0 && !create && errno == ENOENT)
+		return false;
+
+	if (fd < 0)
+	{
+		throw runtime_error("Could not open shared memory '" + name_ + "'. " + strerror(errno));
+	}
+
+	if (create && ftruncate(fd, sizeof(ShmSegment)) != 0)
+	{
+		close(fd);
+		throw runtime_error("Could not resize shared memory '" + name_ + "'. " + strerror(errno));
+	}
+
+	// The server didn't resize it yet
+	struct stat status;
+	if (!create && (fstat(fd, &status) != 0 || status.st_size < (off_t)sizeof(ShmSegment)))
+	{
+		close(fd);
+		return false;
+	}
+
+	void* address = mmap(nullptr, sizeof(ShmSegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (address == MAP_FAILED)
+	{
+		throw runtime_error("Could not map shared memory '" + name_ + "'. " + strerror(errno));
+	}
+
+	segment_ = static_cast<ShmSegment*>(address);
+	return true;
+}
+
+void SharedMemory::startServer(const string& name, const string& info, unsigned int clients)
+{
+	if (clients > SHM_MAX_CLIENTS || info.size() > SHM_INFO_SIZE)
+	{
+		throw runtime_error("Shared memory can't hold " + to_string(clients) + " clients");
+	}
+
+	name_ = '/' + name;
+	id_ = 0;
+	clients_ = clients;
+
+	// A segment that's left from a game that crashed would have old messages
+	shm_unlink(name_.c_str());
+	Map(true);
+
+	// A new segment is filled with zeros, so the queues are empty
+	segment_->clients = clients;
+	segment_->magic.store(SHM_MAGIC, memory_order_release);
+
+	cout << "Waiting for " << clients << " players on shared memory '" << name << "'" << endl;
+
+	// Wait for every client before the game starts so that nobody times out
+	while (segment_->joined.load(memory_order_acquire) < clients)
+	{
+		this_thread::sleep_for(chrono::milliseconds(10));
+	}
+
+	// The clients have it mapped. The name is not needed anymore.
+	shm_unlink(name_.c_str());
+
+	// Each client finds its player number in its queue
+	memcpy(segment_->info, info.data(), info.size());
+	segment_->infoSize = info.size();
+	segment_->started.store(1, memory_order_release);
+}
+
+string SharedMemory::connectClient(const string& name)
+{
+	name_ = '/' + name;
+
+	cout << "Connecting to shared memory '" << name << "'" << endl;
+
+	// The server may not be started yet
+	while (true)
+	{
+		if (Map(false))
+		{
+			if (segment_->magic.load(memory_order_acquire) == SHM_MAGIC)
+				break;
+
+			munmap(segment_, sizeof(ShmSegment));
+			segment_ = nullptr;
+		}
+
+		this_thread::sleep_for(chrono::milliseconds(10));
+	}
+
+	clients_ = segment_->clients;
+	id_ = segment_->joined.fetch_add(1) + 1;
+
+	if (id_ > clients_)
+	{
+		throw runtime_error("The game on shared memory '" + name + "' is full");
+	}
+
+	// Waits until every player joined
+	while (segment_->started.load(memory_order_acquire) == 0)
+	{
+		this_thread::sleep_for(chrono::milliseconds(10));
+	}
+
+	cout << "Joined the game as player " << id_ + 1 << "." << endl;
+
+	return string(segment_->info, segment_->infoSize);
+}
+
+void SharedMemory::Push(ShmQueue& queue, const unsigned char* data, size_t size)
+{
+	uint32_t tail = queue.tail.load(memory_order_relaxed);
+	uint32_t used = tail - queue.head.load(memory_order_acquire);
+	uint32_t length = size;
+
+	if (sizeof(length) + size > SHM_QUEUE_SIZE - used)
+	{
+		// The other player is not reading. It's the same as a lost message.
+		dropped_++;
+		return;
+	}
+
+	Write(queue, tail, &length, sizeof(length));
+	Write(queue, tail + sizeof(length), data, size);
+	queue.tail.store(tail + sizeof(length) + size, memory_order_release);
+}
+
+bool SharedMemory::Pop(ShmQueue& queue)
+{
+	uint32_t head = queue.head.load(memory_order_relaxed);
+	uint32_t tail = queue.tail.load(memory_order_acquire);
+
+	if (head == tail)
+		return false;
+
+	// The other process writes in the same memory, so nothing it wrote is trusted
+	uint32_t used = tail - head;
+	uint32_t length;
+
+	if (used < sizeof(length) || used > SHM_QUEUE_SIZE)
+	{
+		throw runtime_error("Shared memory '" + name_ + "' has a damaged queue");
+	}
+
+	Read(queue, head, &length, sizeof(length));
+
+	if (length > used - sizeof(length))
+	{
+		throw runtime_error("Shared memory '" + name_ + "' has a message of " + to_string(length) + " bytes, larger than its queue");
+	}
+
+	current_.resize(length);
+	Read(queue, head + sizeof(length), current_.data(), length);
+	queue.head.store(head + sizeof(length) + length, memory_order_release);
+
+	return true;
+}
+
+bool SharedMemory::Poll()
+{
+	if (id_ != 0)
+		return Pop(segment_->toClient[id_ - 1]);
+
+	for (unsigned int i = 0; i < clients_; i++)
+	{
+		unsigned int client = (next_ + i) % clients_;
+
+		if (Pop(segment_->toServer[client]))
+		{
+			next_ = (client + 1) % clients_;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool SharedMemory::isServer()
+{
+	return id_ == 0;
+}
+
+unsigned int SharedMemory::myPlayer()
+{
+	return id_;
+}
+
+void SharedMemory::send(const unsigned char* data, size_t size)
+{
+	if (id_ != 0)
+	{
+		Push(segment_->toServer[id_ - 1], data, size);
+		return;
+	}
+
+	for (unsigned int i = 0; i < clients_; i++)
+	{
+		Push(segment_->toClient[i], data, size);
+	}
+}
+
+void SharedMemory::send(const vector<unsigned char>& message)
+{
+	send(message.data(), message.size());
+}
+
+void SharedMemory::sendTo(unsigned int player, const vector<unsigned char>& message)
+{
+	if (id_ != 0 || player == 0 || player > clients_)
+	{
+		throw runtime_error("Network send error. There's no player " + to_string(player) + ".");
+	}
+
+	Push(segment_->toClient[player - 1], message.data(), message.size());
+}
+
+bool SharedMemory::receive(const unsigned char*& data, size_t& size, int timeout)
+{
+	bool received = Poll();
+
+	if (!received && timeout > 0)
+	{
+		auto deadline = chrono::steady_clock::now() + chrono::milliseconds(timeout);
+
+		while (!received && chrono::steady_clock::now() < deadline)
+		{
+			this_thread::sleep_for(chrono::milliseconds(1));
+			received = Poll();
+		}
+	}
+
+	if (!received)
+		return false;
+
+	data = current_.data();
+	size = current_.size();
+
+	return true;
+}
+
+unsigned long SharedMemory::dropped() const
+{
+	return dropped_;
+}
@@ -0,0 +1,70 @@
+// Copyright (C) 2020 Alexandre-Xavier Labonté-Lamoureux
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// shmem.h
+// Transport for the players that are on the same computer. Messages go through
+// a POSIX shared memory segment that has a lock-free queue in each direction for every client.
+
+#ifndef SHMEM_H
+#define SHMEM_H
+
+#include "transport.h"
+
+#include <cstddef>	/* size_t */
+#include <string>
+#include <vector>
+using namespace std;
+
+const unsigned int SHM_MAX_CLIENTS = 63;
+const size_t SHM_QUEUE_SIZE = 64 * 1024;	// Bytes. Must be a power of two.
+const size_t SHM_INFO_SIZE = 4 * 1024;	// Maximum size of the game's settings
+
+struct ShmSegment;
+struct ShmQueue;
+
+class SharedMemory: public Transport
+{
+private:
+	string name_;
+	ShmSegment* segment_ = nullptr;
+	unsigned int id_ = 0;	// The server is 0
+	unsigned int clients_ = 0;
+	unsigned int next_ = 0;	// Server only. Queue that's read first, so that every client gets its turn.
+	vector<unsigned char> current_;	// Message returned by 'receive'
+	unsigned long dropped_ = 0;
+
+	bool Map(bool create);	// False if the segment doesn't exist yet
+	void Push(ShmQueue& queue, const unsigned char* data, size_t size);
+	bool Pop(ShmQueue& queue);
+	bool Poll();
+
+public:
+	SharedMemory();
+	~SharedMemory();
+
+	// 'name' is the name of the segment, without the 'shm://'. Both wait for every player, like 'Network'.
+	void startServer(const string& name, const string& info, unsigned int clients);
+	string connectClient(const string& name);
+
+	bool isServer() override;
+	unsigned int myPlayer() override;
+	void send(const unsigned char* data, size_t size) override;
+	void send(const vector<unsigned char>& message) override;
+	void sendTo(unsigned int player, const vector<unsigned char>& message) override;
+	bool receive(const unsigned char*& data, size_t& size, int timeout) override;
+	unsigned long dropped() const override;
+};
+
+#endif	// SHMEM_H
@@ -0,0 +1,135 @@
+// Copyright (C) 2020 Alexandre-Xavier Labonté-Lamoureux
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// snapbench.cpp
+// Measures the size of the world snapshots and the time it takes to save and load them
+
+#include "snapbench.h"
+#include "command.h"	/* FindArgumentPosition, FindArgumentParameter */
+#include "level.h"
+#include "player.h"
+#include "ticcmd.h"
+#include "random.h"		/* SetIndex */
+#include "archive.h"	/* Resources */
+#include "cache.h"
+#include "actor.h"	/* Plasma */
+
+#include <chrono>
+#include <cmath>		/* cos, sin */
+#include <cstdlib>		/* EXIT_FAILURE, EXIT_SUCCESS */
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+using namespace std;
+
+// Players walk around, turn and shoot
+static Ticcmd benchCmd(unsigned int player, unsigned int tic)
+{
+	Ticcmd cmd;
+	cmd.id = player;
+
+	unsigned int phase = (tic / 17 + player * 3) % 5;
+	cmd.forward = phase == 0 ? 0 : (phase < 3 ? 20 : -15);
+	cmd.lateral = (tic / 23 + player) % 3 == 0 ? 10 : 0;
+	cmd.rotation = (tic / 11 + player) % 4 == 0 ? 300 : 0;
+	cmd.fire = (tic + player) % 3 == 0;
+
+	return cmd;
+}
+
+static void runTic(Level* level, unsigned int tic)
+{
+	for (unsigned int i = 0; i < level->players.size(); i++)
+	{
+		Player* play = level->players[i];
+		play->Cmd = benchCmd(i, tic);
+
+		// Missiles like the bots fire, so that the level fills with things
+		if ((tic + i) % 10 == 0)
+		{
+			float angle = play->GetRadianAngle(play->Angle);
+			level->things.push_back(new Plasma(play->PosX(), play->PosY(), play->CamZ() - 0.5f, cos(angle), sin(angle), 0.0f));
+		}
+	}
+
+	level->RunTic();
+}
+
+// Average time of one call in microseconds
+template <typename F>
+static double timeIt(unsigned int iterations, F function)
+{
+	auto start = chrono::steady_clock::now();
+
+	for (unsigned int i = 0; i < iterations; i++)
+		function();
+
+	chrono::duration<double, micro> elapsed = chrono::steady_clock::now() - start;
+	return elapsed.count() / iterations;
+}
+
+int snapbench(int argc, const char* argv[])
+{
+	string LevelName = FindArgumentParameter(argc, argv, "-level", "test.txt");
+	unsigned int numOfPlayers = stoul(FindArgumentParameter(argc, argv, "-players", "2"));
+	unsigned int tics = stoul(FindArgumentParameter(argc, argv, "-tics", "600"));	// Played before the measures
+	unsigned int iterations = stoul(FindArgumentParameter(argc, argv, "-iterations", "10000"));
+
+	// Only the size of the textures matters for the game
+	Cache::Instance()->SetHeadless();
+
+	string ArchiveName = FindArgumentParameter(argc, argv, "-archive", "meshglide.mgpk");
+	if (!Resources::Instance()->Mount(ArchiveName) && FindArgumentPosition(argc, argv, "-archive") > 0)
+	{
+		throw runtime_error("Could not open archive '" + ArchiveName + "'");
+	}
+
+	SetIndex(stoi(FindArgumentParameter(argc, argv, "-seed", "0")));
+
+	bool Optimize = FindArgumentPosition(argc, argv, "-nooptimize") == 0;
+	Level* CurrentLevel = new Level(LevelName, stof(FindArgumentParameter(argc, argv, "-scale", "1.0")), numOfPlayers, Optimize);
+	CurrentLevel->play = CurrentLevel->players[0];
+
+	for (unsigned int TicCount = 0; TicCount < tics; TicCount++)
+		runTic(CurrentLevel, TicCount);
+
+	// The state must be the same after going back to it, even after the game went on
+	vector<unsigned char> world;
+	CurrentLevel->SaveWorld(world, tics);
+	unsigned int sum = CurrentLevel->Checksum();
+
+	for (unsigned int TicCount = tics; TicCount < tics + 60; TicCount++)
+		runTic(CurrentLevel, TicCount);
+
+	if (CurrentLevel->LoadWorld(world.data(), world.size()) != tics || CurrentLevel->Checksum() != sum)
+	{
+		cerr << "The state is different after loading the world snapshot." << endl;
+		delete CurrentLevel;
+		return EXIT_FAILURE;
+	}
+
+	unsigned int temporary = CurrentLevel->things.size() - CurrentLevel->players.size() - CurrentLevel->weapons.size();
+	cout << "World snapshot of " << world.size() << " bytes for " << numOfPlayers << " players and "
+		<< temporary << " temporary things after " << tics << " tics." << endl;
+
+	double saveTime = timeIt(iterations, [&]() { CurrentLevel->SaveWorld(world, tics); });
+	double loadTime = timeIt(iterations, [&]() { CurrentLevel->LoadWorld(world.data(), world.size()); });
+
+	cout << "SaveWorld: " << saveTime << " us, LoadWorld: " << loadTime << " us (average of " << iterations << ")." << endl;
+
+	delete CurrentLevel;
+	return EXIT_SUCCESS;
+}
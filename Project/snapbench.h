@@ -0,0 +1,25 @@
+// Copyright (C) 2020 Alexandre-Xavier Labonté-Lamoureux
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// snapbench.h
+// Measures the size of the world snapshots and the time it takes to save and load them
+
+#ifndef SNAPBENCH_H
+#define SNAPBENCH_H
+
+// Plays a level without a window, then saves and loads its state many times. Doesn't use OpenGL.
+int snapbench(int argc, const char* argv[]);
+
+#endif	// SNAPBENCH_H
@@ -17,6 +17,7 @@
 // Texture loader
 
 #include "texture.h"
+#include "archive.h"	/* Resources, Lump */
 
 #include <SDL2/SDL_image.h>
 #include <GL/gl.h>
@@ -25,23 +26,168 @@
 #include <string>
 #include <iostream>
 #include <utility>	/* swap */
-#include <algorithm>	/* transform */
+#include <algorithm>	/* transform, equal */
 #include <stdexcept>
 using namespace std;
 
-Texture::Texture(const string& Path, bool enableFiltering)
+static string GetExtension(const string& Path)
 {
+	if (Path.find_last_of(".") != string::npos)
+	{
+		string ext = Path.substr(Path.find_last_of(".") + 1);
+		transform(ext.begin(), ext.end(), ext.begin(), ::tolower);	// :: because it's not defined in the global namespace
+		return ext;
+	}
+	return "";
+}
+
+SDL_Surface* Texture::Decode(const string& Path)
+{
+	// Don't support other file extensions because they were not tested
+	string ext = GetExtension(Path);
+	if (ext != "jpg" && ext != "png")
+	{
+		throw runtime_error("File " + Path + " has extension '" + ext + "' which is an unsupported format.");
+	}
+
+	// The image is decoded straight from the loose file or the archive's mapping
+	Lump lump = Resources::Instance()->Open(Path);
+
+	if (!lump.IsOpen())
+	{
+		throw runtime_error("Error loading texture '" + Path + "'\nCause: File not found");
+	}
+
 	// Surface: Blue, Green, Red
-	SDL_Surface* Surface = IMG_Load(Path.c_str());
+	SDL_Surface* Surface = IMG_Load_RW(SDL_RWFromConstMem(lump.Data(), lump.Size()), 1);
 
 	if (!Surface)
 	{
 		throw runtime_error("Error loading texture '" + Path + "'\nCause: " + IMG_GetError());
 	}
 
-	Name_ = Path;
+	return Surface;
+}
+
+static unsigned int ReadBigEndian(const unsigned char* bytes, size_t count)
+{
+	unsigned int value = 0;
+
+	for (size_t i = 0; i < count; i++)
+		value = (value << 8) | bytes[i];
+
+	return value;
+}
+
+void Texture::ReadSize(const string& Path, unsigned short& Width, unsigned short& Height)
+{
+	string ext = GetExtension(Path);
+	if (ext != "jpg" && ext != "png")
+	{
+		throw runtime_error("File " + Path + " has extension '" + ext + "' which is an unsupported format.");
+	}
+
+	Lump lump = Resources::Instance()->Open(Path);
+
+	if (!lump.IsOpen())
+	{
+		throw runtime_error("Error reading texture '" + Path + "'\nCause: File not found");
+	}
+
+	const unsigned char* data = lump.Data();
+	size_t size = lump.Size();
+
+	// PNG: the signature is followed by the IHDR chunk, which starts with the width and the height
+	const unsigned char PNG_SIGNATURE[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+	if (size >= 24 && equal(PNG_SIGNATURE, PNG_SIGNATURE + 8, data) && equal(data + 12, data + 16, "IHDR"))
+	{
+		Width = ReadBigEndian(data + 16, 4);
+		Height = ReadBigEndian(data + 20, 4);
+		return;
+	}
+
+	// JPEG: the size is in the start of frame segment. The segments before it are skipped.
+	if (size >= 4 && data[0] == 0xFF && data[1] == 0xD8)
+	{
+		size_t pos = 2;
+
+		while (pos + 4 <= size)
+		{
+			if (data[pos] != 0xFF)
+				break;
+
+			unsigned char marker = data[pos + 1];
+
+			// Padding and markers without a length
+			if (marker == 0xFF)
+			{
+				pos++;
+				continue;
+			}
+			if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7))
+			{
+				pos += 2;
+				continue;
+			}
+
+			size_t length = ReadBigEndian(data + pos + 2, 2);
+
+			// SOF0 to SOF15, except DHT, JPG and DAC which use the same range
+			if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC)
+			{
+				if (pos + 9 > size)
+					break;
+
+				Height = ReadBigEndian(data + pos + 5, 2);
+				Width = ReadBigEndian(data + pos + 7, 2);
+				return;
+			}
+
+			// The image data starts without a frame
+			if (marker == 0xDA || marker == 0xD9)
+				break;
+
+			pos += 2 + length;
+		}
+	}
+
+	throw runtime_error("Error reading texture '" + Path + "'\nCause: Could not find the size in the header");
+}
+
+Texture::Texture(const string& Path, bool enableFiltering, bool upload)
+{
+	if (!upload)
+	{
+		// The pixels are not needed, so they are not decoded
+		Name_ = Path;
+		Id_ = 0;
+		Bytes_ = 0;
+		ReadSize(Path, Width_, Height_);
+		return;
+	}
+
+	Create(Path, Decode(Path), enableFiltering, upload);
+}
+
+Texture::Texture(const string& Name, SDL_Surface* Surface, bool enableFiltering, bool upload)
+{
+	Create(Name, Surface, enableFiltering, upload);
+}
+
+void Texture::Create(const string& Name, SDL_Surface* Surface, bool enableFiltering, bool upload)
+{
+	Name_ = Name;
 	Width_ = Surface->w;
 	Height_ = Surface->h;
+	Bytes_ = Surface->w * Surface->h * Surface->format->BytesPerPixel;
+	Id_ = 0;
+
+	if (!upload)
+	{
+		Bytes_ = 0;
+		SDL_FreeSurface(Surface);
+		return;
+	}
 
 	// Create an OpenGL texture
 	GLuint textureID;
@@ -50,12 +196,6 @@ Texture::Texture(const string& Path, bool enableFiltering)
 	// Bind the texture so that the next functions will modify that texture
 	glBindTexture(GL_TEXTURE_2D, textureID);
 
-	// Don't support other file extensions because they were not tested
-	if (Extension() != "jpg" && Extension() != "png")
-	{
-		throw runtime_error("File " + Path + " has extension '" + Extension() + "' which is an unsupported format.");
-	}
-
 	GLint Mode;
 
 	string bits = to_string(Surface->format->BitsPerPixel);
@@ -70,7 +210,8 @@ Texture::Texture(const string& Path, bool enableFiltering)
 	}
 	else
 	{
-		throw runtime_error("Texture " + Path + " has an unsupported number of bits per pixel (" + bits + " bpp)");
+		SDL_FreeSurface(Surface);
+		throw runtime_error("Texture " + Name + " has an unsupported number of bits per pixel (" + bits + " bpp)");
 	}
 
 	// Load the texture. The GL_BGR format should be used, but the bytes of the buffer have been flipped above.
@@ -100,7 +241,7 @@ Texture::Texture(const string& Path, bool enableFiltering)
 		throw runtime_error((const char*)gluErrorString(ErrorCode));
 	}
 
-	cout << "Texture loaded: '" << Path << "' is " << Surface->w << 'x' << Surface->h << 'x' << bits << endl;
+	cout << "Texture loaded: '" << Name << "' is " << Surface->w << 'x' << Surface->h << 'x' << bits << endl;
 
 	// Set the ID and free the surface
 	Id_ = textureID;
@@ -114,13 +255,7 @@ string Texture::Name() const
 
 string Texture::Extension() const
 {
-	if (Name_.find_last_of(".") != string::npos)
-	{
-		string ext = Name_.substr(Name_.find_last_of(".") + 1);
-		transform(ext.begin(), ext.end(), ext.begin(), ::tolower);	// :: because it's not defined in the global namespace
-		return ext;
-	}
-	return "";
+	return GetExtension(Name_);
 }
 
 GLuint Texture::Id() const
@@ -138,12 +273,21 @@ unsigned short Texture::Height() const
 	return Height_;
 }
 
+unsigned int Texture::Bytes() const
+{
+	return Bytes_;
+}
+
 void Texture::Bind()
 {
 	glBindTexture(GL_TEXTURE_2D, Id_);
 }
 
 Texture::~Texture() {
-	cout << "Deleting texture " << Name_ << " (" << Id_ << ")" << endl;
-	glDeleteTextures(1, &Id_);
+	// Textures that were not uploaded have no ID
+	if (Id_ != 0)
+	{
+		cout << "Deleting texture " << Name_ << " (" << Id_ << ")" << endl;
+		glDeleteTextures(1, &Id_);
+	}
 }
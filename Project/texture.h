@@ -24,6 +24,8 @@
 #include <string>
 using namespace std;
 
+struct SDL_Surface;
+
 class Texture
 {
 private:
@@ -31,16 +33,28 @@ private:
 	GLuint Id_;
 	unsigned short Width_;
 	unsigned short Height_;
+	unsigned int Bytes_;	// Memory used by the pixels
+
+	void Create(const string& Name, SDL_Surface* Surface, bool enableFiltering, bool upload);
 public:
 	Texture() = delete;
-	Texture(const string& Path, bool enableFiltering);
+	// Without 'upload', only the size is read from the file's header. It doesn't need OpenGL, so it's used by the headless clients.
+	Texture(const string& Path, bool enableFiltering, bool upload = true);
+	Texture(const string& Name, SDL_Surface* Surface, bool enableFiltering, bool upload = true);	// Uploads and frees the surface
 	~Texture();
 
+	// Decoding doesn't need OpenGL, so it can be done on another thread
+	static SDL_Surface* Decode(const string& Path);
+
+	// Width and height from the header of a PNG or a JPEG, without decoding the pixels
+	static void ReadSize(const string& Path, unsigned short& Width, unsigned short& Height);
+
 	string Name() const;
 	string Extension() const;
 	unsigned int Id() const;
 	unsigned short Width() const;
 	unsigned short Height() const;
+	unsigned int Bytes() const;
 	void Bind();
 };
 
@@ -19,8 +19,6 @@
 
 #include "ticcmd.h"
 
-#include <SDL2/SDL_endian.h>	/* SDL_BYTEORDER, SDL_BIG_ENDIAN */
-
 #include <sstream>
 #include <string>
 #include <vector>
@@ -42,49 +40,40 @@ void Ticcmd::Reset()
 	rotation = 0;
 	vertical = 0;
 	fire = false;
-	chat = "";
 }
 
-// Encodes a player's data to a buffer for network usage
-vector<unsigned char> Ticcmd::Serialize() const
+// 'buffer' must hold 'TICCMD_SIZE' bytes
+void Ticcmd::Pack(unsigned char* buffer) const
 {
-	// Serialize the command
-	vector<unsigned char> c;
-	c.resize(8, 0);	// It must be at least 8 bytes long
-
-	c[0] = quit;
-	c[0] = c[0] << 1;
-
-	c[0] = c[0] | fire;
-	c[0] = c[0] << 6;
-
-	c[0] = c[0] | id;
-
-	c[1] = forward;
-	c[2] = lateral;
-
-#if SDL_BYTEORDER == SDL_BIG_ENDIAN
-	c[3] = rotation;
-	c[4] = rotation >> 8;
+	buffer[0] = (quit ? 128 : 0) | (fire ? 64 : 0) | (id & 63);
+	buffer[1] = forward;
+	buffer[2] = lateral;
+
+	// Most significant byte first, like in the demos of the previous versions
+	buffer[3] = rotation >> 8;
+	buffer[4] = rotation;
+	buffer[5] = vertical >> 8;
+	buffer[6] = vertical;
+}
 
-	c[5] = vertical;
-	c[6] = vertical >> 8;
-#else
-	c[3] = rotation >> 8;
-	c[4] = rotation;
+void Ticcmd::Unpack(const unsigned char* buffer)
+{
+	quit = buffer[0] & 128;
+	fire = buffer[0] & 64;
+	id = buffer[0] & 63;
 
-	c[5] = vertical >> 8;
-	c[6] = vertical;
-#endif
+	forward = buffer[1];
+	lateral = buffer[2];
 
-	// Save the chat string's size
-	c[7] = chat.size();
+	rotation = (buffer[3] << 8) | buffer[4];
+	vertical = (buffer[5] << 8) | buffer[6];
+}
 
-	// Write chat string to buffer
-	for (unsigned int i = 0; i < chat.size(); i++)
-	{
-		c.push_back(chat[i]);
-	}
+// Encodes a player's data to a buffer for network usage
+vector<unsigned char> Ticcmd::Serialize() const
+{
+	vector<unsigned char> c(TICCMD_SIZE);
+	Pack(c.data());
 
 	return c;
 }
@@ -99,54 +88,19 @@ vector<unsigned char> Ticcmd::Serialize2() const
 
 	s += to_string(forward) + ' ' + to_string(lateral) + ' ';
 
-	s += to_string(rotation) + ' ' + to_string(vertical) + ' ';
-
-	s += chat;
+	s += to_string(rotation) + ' ' + to_string(vertical);
 
 	return vector<unsigned char>(s.begin(), s.end());
 }
 
 // Decodes a player's data from a buffer and write to command
-void Ticcmd::Deserialize(vector<unsigned char> v)
+void Ticcmd::Deserialize(const vector<unsigned char>& v)
 {
-	// Safety check if not a least 8 bytes
-	if (v.size() < 8)
+	// Safety check if not a least 7 bytes
+	if (v.size() < TICCMD_SIZE)
 		return;
 
-	// Deserialize the command
-	quit = v[0] & 128;
-	fire = v[0] & 64;
-	id = v[0] & 63;
-
-	forward = v[1];
-	lateral = v[2];
-
-#if SDL_BYTEORDER == SDL_BIG_ENDIAN
-	rotation = v[4];
-	rotation <<= 8;
-	rotation |= v[3];
-
-	vertical = v[6];
-	vertical <<= 8;
-	vertical |= v[5];
-#else
-	rotation = v[3];
-	rotation <<= 8;
-	rotation |= v[4];
-
-	vertical = v[5];
-	vertical <<= 8;
-	vertical |= v[6];
-#endif
-
-	// Empty the chat sting inside the command
-	chat.clear();
-
-	// Write the chat string to the command
-	for (unsigned int i = 0; i < v[7] && i < 36; i++)
-	{
-		chat.push_back(v[i + 8]);
-	}
+	Unpack(v.data());
 }
 
 // Decodes a player's data from a buffer and write to command
@@ -177,8 +131,4 @@ void Ticcmd::Deserialize2(vector<unsigned char> v)
 
 	if (getline(split, token, ' '))
 		vertical = stoi(token);
-
-	// The remainder is the chat string
-	if (getline(split, token, '\0'))
-		chat = token;
 }
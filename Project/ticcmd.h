@@ -22,28 +22,49 @@
 
 #include <string>
 #include <vector>
+#include <type_traits>	/* is_trivially_copyable */
 
 using namespace std;
 
+// Size of a command, in memory and once packed
+const unsigned int TICCMD_SIZE = 7;
+
+// Commands can be copied with memcpy and stored in arrays without padding
+#pragma pack(push, 1)
 class Ticcmd
 {
 public:
-	unsigned char id;
+	unsigned char id: 6;
+	bool fire: 1;
+	bool quit: 1;
 	signed char forward;
 	signed char lateral;
 	short rotation;
 	short vertical;
-	bool fire;
-	bool quit;
-	string chat;
 
 	Ticcmd();
 	void Reset();
 
+	// Portable layout that doesn't depend on the byte order. They don't allocate anything.
+	void Pack(unsigned char* buffer) const;
+	void Unpack(const unsigned char* buffer);
+
 	vector<unsigned char> Serialize() const;	// raw binary
 	vector<unsigned char> Serialize2() const;	// line of text
-	void Deserialize(vector<unsigned char> v);	// raw binary
+	void Deserialize(const vector<unsigned char>& v);	// raw binary
 	void Deserialize2(vector<unsigned char> v);	// line of text
 };
+#pragma pack(pop)
+
+static_assert(sizeof(Ticcmd) == TICCMD_SIZE, "A command must be 7 bytes");
+static_assert(is_trivially_copyable<Ticcmd>::value, "A command must be trivially copyable");
+
+// Chat messages are not part of the commands. They are sent separately and shown when their tic is reached.
+struct ChatMessage
+{
+	unsigned int tic;
+	unsigned int player;
+	string text;
+};
 
 #endif /* TICCMD_H */
@@ -0,0 +1,49 @@
+// Copyright (C) 2020 Alexandre-Xavier Labonté-Lamoureux
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// mgpack.cpp
+// Packer tool. Puts the game's resources in a single archive.
+// Usage: mgpack <archive> <files...>
+
+#include "../archive.h"
+
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <cstdlib>		/* EXIT_FAILURE, EXIT_SUCCESS */
+
+using namespace std;
+
+int main(int argc, const char* argv[])
+{
+	if (argc < 3)
+	{
+		cerr << "Usage: " << argv[0] << " <archive> <files...>" << endl;
+		return EXIT_FAILURE;
+	}
+
+	try
+	{
+		PackArchive(argv[1], vector<string>(argv + 2, argv + argc));
+	}
+	catch (const exception& e)
+	{
+		cerr << "Fatal error: " << e.what() << endl;
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
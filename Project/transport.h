@@ -0,0 +1,45 @@
+// Copyright (C) 2020 Alexandre-Xavier Labonté-Lamoureux
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// transport.h
+// Interface of what carries the messages of a multiplayer game
+
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include <cstddef>	/* size_t */
+#include <vector>
+using namespace std;
+
+class Transport
+{
+public:
+	virtual ~Transport() {}
+
+	static const int TIMEOUT = 10 * 1000;	// ms
+
+	virtual bool isServer() = 0;
+	virtual unsigned int myPlayer() = 0;
+
+	// They never block. The server sends to every client, clients send to the server.
+	virtual void send(const unsigned char* data, size_t size) = 0;
+	virtual void send(const vector<unsigned char>& message) = 0;
+	virtual void sendTo(unsigned int player, const vector<unsigned char>& message) = 0;	// Server only
+	// Waits up to 'timeout' ms. Returns false if nothing arrived. 'data' is valid until the next call.
+	virtual bool receive(const unsigned char*& data, size_t& size, int timeout) = 0;
+	virtual unsigned long dropped() const = 0;	// Messages that were lost before being sent
+};
+
+#endif	// TRANSPORT_H
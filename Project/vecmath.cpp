@@ -46,11 +46,16 @@ constexpr float Float3::operator[](const int attribute_index) const
 
 // Ray-casting algorithm used to find if a 2D coordinate is on a 3D polygon
 bool pointInPoly(const float x, const float y, const vector<Float3>& vertices, const int attr1, const int attr2)
+{
+	return pointInPoly(x, y, vertices.data(), vertices.size(), attr1, attr2);
+}
+
+bool pointInPoly(const float x, const float y, const Float3* vertices, const unsigned int count, const int attr1, const int attr2)
 {
 	bool inside = false;
 	// Iterate over every edge. Trace an infinite ray starting from the point.
 	// If the number of intersections if even, it's outside. If it's odd, the point is inside.
-	for (unsigned int i = 0, j = vertices.size() - 1; i < vertices.size(); j = i++) {
+	for (unsigned int i = 0, j = count - 1; i < count; j = i++) {
 		// Create new variables for readability
 		float xi = vertices[i][attr1];
 		float yi = vertices[i][attr2];
@@ -150,6 +155,11 @@ Float3 RayIntersect(const Float3& ray, const Float3& origin, const Float3& norma
 
 // Returns a normalized normal
 Float3 ComputeNormal(const vector<Float3>& vertices)
+{
+	return ComputeNormal(vertices.data(), vertices.size());
+}
+
+Float3 ComputeNormal(const Float3* vertices, const unsigned int)
 {
 	// Vector 'u'
 	Float3 u = {vertices[1].x - vertices[0].x, vertices[1].y - vertices[0].y, vertices[1].z - vertices[0].z};
@@ -163,16 +173,21 @@ Float3 ComputeNormal(const vector<Float3>& vertices)
 
 // Can compute the center of a polygon (its centroid) by doing an average of all of its vertices
 Float3 ComputeAverage(const vector<Float3>& vertices)
+{
+	return ComputeAverage(vertices.data(), vertices.size());
+}
+
+Float3 ComputeAverage(const Float3* vertices, const unsigned int count)
 {
 	// Center of polygon
 	Float3 total = {0, 0, 0};
-	for (unsigned int i = 0; i < vertices.size(); i++)
+	for (unsigned int i = 0; i < count; i++)
 	{
 		total.x += vertices[i].x;
 		total.y += vertices[i].y;
 		total.z += vertices[i].z;
 	}
-	return {total.x / vertices.size(), total.y / vertices.size(), total.z / vertices.size()};
+	return {total.x / count, total.y / count, total.z / count};
 }
 
 // TODO: This function could be removed entirely or moved to "physics.cpp"
@@ -56,6 +56,7 @@ bool allEqualZ(const vector<Float3>& vertices);
 // The two last parameters define if the test is going to be done on xOy (default), yOz or zOx
 // If called without the two last parameters, it uses the polygon's X and Y coordinates for the test (xOy)
 bool pointInPoly(const float x, const float y, const vector<Float3>& vertices, const int attr1 = 0, const int attr2 = 1);
+bool pointInPoly(const float x, const float y, const Float3* vertices, const unsigned int count, const int attr1 = 0, const int attr2 = 1);
 
 Float3 crossProduct(const Float3& u, const Float3& v);
 
@@ -82,7 +83,9 @@ Float3 RayIntersect(const Float3& ray, const Float3& origin, const Float3& norma
 // https://www.scratchapixel.com/lessons/3d-basic-rendering/minimal-ray-tracer-rendering-simple-shapes/ray-plane-and-ray-disk-intersection
 
 Float3 ComputeNormal(const vector<Float3>& vertices);
+Float3 ComputeNormal(const Float3* vertices, const unsigned int count);
 Float3 ComputeAverage(const vector<Float3>& vertices);
+Float3 ComputeAverage(const Float3* vertices, const unsigned int count);
 
 // Get height on a polygon
 float PointHeightOnPoly(const float x, const float y, const float z, const Float3& normal, const Float3& centroid);
@@ -20,7 +20,10 @@
 #include "actor.h"
 #include "player.h"
 #include "level.h"
+#include "plane.h"	// Plane, NO_TEXTURE
 #include "vecmath.h" // Float3
+#include "archive.h"	// Resources, Lump
+#include "cache.h"
 
 #include <SDL2/SDL_image.h>
 #include <GLFW/glfw3.h>
@@ -181,7 +184,7 @@ void SetWindowTitle(GLFWwindow* window, string Title)
 	glfwSetWindowTitle(window, Title.c_str());
 }
 
-GLFWwindow* Init_OpenGL(const bool fullscreen, const string& title)
+GLFWwindow* Init_OpenGL(const bool fullscreen, const string& title, const bool vsync)
 {
 	// Create the window
 	GLFWwindow* window;
@@ -219,7 +222,8 @@ GLFWwindow* Init_OpenGL(const bool fullscreen, const string& title)
 	// Set icon. Feature was added to GLFW 3.2
 #if GLFW_VERSION_MINOR >= 2
 	GLFWimage icon;
-	SDL_Surface* Surface = IMG_Load(WindowIcon.c_str());
+	Lump lump = Resources::Instance()->Open(WindowIcon);
+	SDL_Surface* Surface = lump.IsOpen() ? IMG_Load_RW(SDL_RWFromConstMem(lump.Data(), lump.Size()), 1) : nullptr;
 	if (Surface != nullptr)
 	{
 		icon.width = Surface->w;
@@ -231,7 +235,7 @@ GLFWwindow* Init_OpenGL(const bool fullscreen, const string& title)
 #endif
 
 	// Vsync?
-	glfwSwapInterval(0);	// If it's not zero, the framerate is at least limited to the screen's refresh rate.
+	glfwSwapInterval(vsync ? 1 : 0);	// If it's not zero, the framerate is at least limited to the screen's refresh rate.
 
 	// Set important stuff
 	glfwSetKeyCallback(window, Key_Callback);
@@ -247,6 +251,10 @@ GLFWwindow* Init_OpenGL(const bool fullscreen, const string& title)
 	glEnable(GL_DEPTH_TEST);		// Draw objects at the appropriate Z
 	glEnable(GL_CULL_FACE);		// Don't draw faces behind polygons
 
+	// Textures of the interface are kept as long as the window exists
+	Cache::Instance()->Acquire(fontfile, false);
+	Cache::Instance()->Acquire(crosshair, false);
+
 	return window;
 }
 
@@ -272,9 +280,6 @@ void RenderText(Level* lvl, string text, float x, float y, float sx, float sy)
 	glMatrixMode(GL_MODELVIEW);
 	glLoadIdentity();
 
-	// Init font texture
-	lvl->AddTexture(fontfile, false);
-
 	// Bind the texture that has the fonts
 	lvl->UseTexture(fontfile);
 
@@ -329,11 +334,8 @@ void DrawCursor(Level* lvl)
 	glMatrixMode(GL_MODELVIEW);
 	glLoadIdentity();
 
-	// Init font texture
-	lvl->AddTexture("crosshair.png", false);
-
-	// Bind the texture that has the fonts
-	lvl->UseTexture("crosshair.png");
+	// Bind the crosshair's texture
+	lvl->UseTexture(crosshair);
 
 	glColor4f(1.0f, 1.0f, 1.0f, 1.0f);	// Reset the texture colorization to be neutral
 
@@ -355,7 +357,7 @@ void DrawCursor(Level* lvl)
 }
 
 // Render the screen. Convert in-game axes system to OpenGL axes. (X,Y,Z) becomes (Y,Z,X).
-void DrawScreen(GLFWwindow* window, Player* play, Level* lvl, unsigned int FrameDelay)
+void DrawScreen(GLFWwindow* window, Player* play, Level* lvl, unsigned int FrameDelay, float Alpha)
 {
 	// Reset colors and depth buffer
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -365,15 +367,20 @@ void DrawScreen(GLFWwindow* window, Player* play, Level* lvl, unsigned int Frame
 	// Enable textures
 	glEnable(GL_TEXTURE_2D);
 
-	float HorizontalRotation = play->GetRadianAngle(play->Angle);
+	// The view is between the last two tics
+	short Angle = play->InterpolateAngle(Alpha);
+	Float3 Feet = play->Interpolate(Alpha);
+	Float3 Cam = play->InterpolateCam(Alpha);
+
+	float HorizontalRotation = play->GetRadianAngle(Angle);
 	// Rotate the player in order to look left and right
 	glRotatef(HorizontalRotation * (180.0f / M_PI) + 180.0f, 0, -1, 0);
 
 	// Look up and down
-	glRotatef(play->VerticalAim * (180.0f / M_PI), sin(HorizontalRotation + M_PI_2), 0, cos(HorizontalRotation + M_PI_2));
+	glRotatef(play->InterpolateAim(Alpha) * (180.0f / M_PI), sin(HorizontalRotation + M_PI_2), 0, cos(HorizontalRotation + M_PI_2));
 
 	// Set the camera to the player's position
-	glTranslatef(-play->CamY(), -play->CamZ(), -play->CamX());
+	glTranslatef(-Cam.y, -Cam.z, -Cam.x);
 
 	// Enable transparency
 	glEnable(GL_BLEND);
@@ -396,13 +403,13 @@ void DrawScreen(GLFWwindow* window, Player* play, Level* lvl, unsigned int Frame
 					// (Xpos, Zpos, Ypos)
 					// TODO: Use this for sky coords: glTranslatef(play->PosY, play->PosZ, play->PosX);
 					glTexCoord2f(-1, 1);
-					glVertex3f(play->PosY() + lvl->SkyHeigth * 20.0f, play->PosZ() + lvl->SkyHeigth, play->PosX() - lvl->SkyHeigth * 20.0f);
+					glVertex3f(Feet.y + lvl->SkyHeigth * 20.0f, Feet.z + lvl->SkyHeigth, Feet.x - lvl->SkyHeigth * 20.0f);
 					glTexCoord2f(1, 1);
-					glVertex3f(play->PosY() + lvl->SkyHeigth * 20.0f, play->PosZ() + lvl->SkyHeigth, play->PosX() + lvl->SkyHeigth * 20.0f);
+					glVertex3f(Feet.y + lvl->SkyHeigth * 20.0f, Feet.z + lvl->SkyHeigth, Feet.x + lvl->SkyHeigth * 20.0f);
 					glTexCoord2f(1, -1);
-					glVertex3f(play->PosY() - lvl->SkyHeigth * 20.0f, play->PosZ() + lvl->SkyHeigth, play->PosX() + lvl->SkyHeigth * 20.0f);
+					glVertex3f(Feet.y - lvl->SkyHeigth * 20.0f, Feet.z + lvl->SkyHeigth, Feet.x + lvl->SkyHeigth * 20.0f);
 					glTexCoord2f(-1, -1);
-					glVertex3f(play->PosY() - lvl->SkyHeigth * 20.0f, play->PosZ() + lvl->SkyHeigth, play->PosX() - lvl->SkyHeigth * 20.0f);
+					glVertex3f(Feet.y - lvl->SkyHeigth * 20.0f, Feet.z + lvl->SkyHeigth, Feet.x - lvl->SkyHeigth * 20.0f);
 				glEnd();
 			glPopMatrix();
 		}
@@ -412,11 +419,13 @@ void DrawScreen(GLFWwindow* window, Player* play, Level* lvl, unsigned int Frame
 		// Draw walls
 		for (unsigned int i = 0; i < lvl->planes.size(); i++)
 		{
-			if (!lvl->planes[i]->Texture.empty())
+			const Plane& p = lvl->planes[i];
+
+			if (p.Texture != NO_TEXTURE)
 			{
-				lvl->UseTexture(lvl->planes[i]->Texture);
+				lvl->UseTexture(p.Texture);
 
-				if (lvl->planes[i]->TwoSided)
+				if (p.TwoSided)
 					glDisable(GL_CULL_FACE);
 				else
 					glEnable(GL_CULL_FACE);
@@ -425,76 +434,30 @@ void DrawScreen(GLFWwindow* window, Player* play, Level* lvl, unsigned int Frame
 				{
 					//glTranslatef(0, 0, 0);
 					// Light: Could be made RGB tint later
-					glColor3f(lvl->planes[i]->Light, lvl->planes[i]->Light, lvl->planes[i]->Light);
+					glColor3f(p.Light, p.Light, p.Light);
 
-					if (lvl->HasUVs())
-					{
-						// Notice: The Y axis on the texture coordinate is flipped (see: https://halfgeek.org/wiki/Vertically_invert_a_surface_in_SDL)
-
-						if (lvl->planes[i]->Vertices.size() == 4)
-						{
-							// Polygons that are square
-							glBegin(GL_QUADS);
-							{
-								glTexCoord2f(lvl->planes[i]->UVs[0].x, -lvl->planes[i]->UVs[0].y);
-								glVertex3f(lvl->planes[i]->Vertices[0].y, lvl->planes[i]->Vertices[0].z, lvl->planes[i]->Vertices[0].x);
-								glTexCoord2f(lvl->planes[i]->UVs[1].x, -lvl->planes[i]->UVs[1].y);
-								glVertex3f(lvl->planes[i]->Vertices[1].y, lvl->planes[i]->Vertices[1].z, lvl->planes[i]->Vertices[1].x);
-								glTexCoord2f(lvl->planes[i]->UVs[2].x, -lvl->planes[i]->UVs[2].y);
-								glVertex3f(lvl->planes[i]->Vertices[2].y, lvl->planes[i]->Vertices[2].z, lvl->planes[i]->Vertices[2].x);
-								glTexCoord2f(lvl->planes[i]->UVs[3].x, -lvl->planes[i]->UVs[3].y);
-								glVertex3f(lvl->planes[i]->Vertices[3].y, lvl->planes[i]->Vertices[3].z, lvl->planes[i]->Vertices[3].x);
-							}
-							glEnd();
-						}
-						else if (lvl->planes[i]->Vertices.size() == 3)
-						{
-							// Polygons that have a triangular shape
-							glBegin(GL_TRIANGLES);
-							{
-								glTexCoord2f(lvl->planes[i]->UVs[0].x, -lvl->planes[i]->UVs[0].y);
-								glVertex3f(lvl->planes[i]->Vertices[0].y, lvl->planes[i]->Vertices[0].z, lvl->planes[i]->Vertices[0].x);
-								glTexCoord2f(lvl->planes[i]->UVs[1].x, -lvl->planes[i]->UVs[1].y);
-								glVertex3f(lvl->planes[i]->Vertices[1].y, lvl->planes[i]->Vertices[1].z, lvl->planes[i]->Vertices[1].x);
-								glTexCoord2f(lvl->planes[i]->UVs[2].x, -lvl->planes[i]->UVs[2].y);
-								glVertex3f(lvl->planes[i]->Vertices[2].y, lvl->planes[i]->Vertices[2].z, lvl->planes[i]->Vertices[2].x);
-							}
-							glEnd();
-						}
-					}
-					else	// No UVs
+					// Polygons are square or have a triangular shape
+					glBegin(p.Count == 4 ? GL_QUADS : GL_TRIANGLES);
 					{
-						if (lvl->planes[i]->Vertices.size() == 4)
+						for (unsigned int j = 0; j < p.Count; j++)
 						{
-							// Polygons that are square
-							glBegin(GL_QUADS);
+							if (lvl->HasUVs())
 							{
-								glTexCoord2f(0, 1 * lvl->planes[i]->Yscale);
-								glVertex3f(lvl->planes[i]->Vertices[0].y, lvl->planes[i]->Vertices[0].z, lvl->planes[i]->Vertices[0].x);
-								glTexCoord2f(1 * lvl->planes[i]->Xscale, 1 * lvl->planes[i]->Yscale);
-								glVertex3f(lvl->planes[i]->Vertices[1].y, lvl->planes[i]->Vertices[1].z, lvl->planes[i]->Vertices[1].x);
-								glTexCoord2f(1 * lvl->planes[i]->Xscale, 0);
-								glVertex3f(lvl->planes[i]->Vertices[2].y, lvl->planes[i]->Vertices[2].z, lvl->planes[i]->Vertices[2].x);
-								glTexCoord2f(0, 0);
-								glVertex3f(lvl->planes[i]->Vertices[3].y, lvl->planes[i]->Vertices[3].z, lvl->planes[i]->Vertices[3].x);
+								// Notice: The Y axis on the texture coordinate is flipped (see: https://halfgeek.org/wiki/Vertically_invert_a_surface_in_SDL)
+								const Float2& uv = lvl->uvs[p.UVs[j]];
+								glTexCoord2f(uv.x, -uv.y);
 							}
-							glEnd();
-						}
-						else if (lvl->planes[i]->Vertices.size() == 3)
-						{
-							// Polygons that have a triangular shape
-							glBegin(GL_TRIANGLES);
+							else
 							{
-								glTexCoord2f(0, 1 * lvl->planes[i]->Yscale);
-								glVertex3f(lvl->planes[i]->Vertices[0].y, lvl->planes[i]->Vertices[0].z, lvl->planes[i]->Vertices[0].x);
-								glTexCoord2f(1 * lvl->planes[i]->Xscale, 1 * lvl->planes[i]->Yscale);
-								glVertex3f(lvl->planes[i]->Vertices[1].y, lvl->planes[i]->Vertices[1].z, lvl->planes[i]->Vertices[1].x);
-								glTexCoord2f(1 * lvl->planes[i]->Xscale, 0);
-								glVertex3f(lvl->planes[i]->Vertices[2].y, lvl->planes[i]->Vertices[2].z, lvl->planes[i]->Vertices[2].x);
+								// The texture is stretched over the polygon
+								glTexCoord2f(j == 1 || j == 2 ? p.Xscale : 0, j < 2 ? p.Yscale : 0);
 							}
-							glEnd();
+
+							const Float3& v = lvl->vertices[p.Vertices[j]];
+							glVertex3f(v.y, v.z, v.x);
 						}
 					}
+					glEnd();
 				}
 				glPopMatrix();
 			}
@@ -506,7 +469,8 @@ void DrawScreen(GLFWwindow* window, Player* play, Level* lvl, unsigned int Frame
 		// Draw "things" on the map
 		for (unsigned int i = 0; i < lvl->things.size(); i++)
 		{
-			lvl->things[i]->GetSprite(lvl->play->pos_)->Bind();
+			lvl->things[i]->GetSprite(Feet)->Bind();
+			Float3 Pos = lvl->things[i]->Interpolate(Alpha);
 
 			glPushMatrix();
 			{
@@ -515,30 +479,30 @@ void DrawScreen(GLFWwindow* window, Player* play, Level* lvl, unsigned int Frame
 
 				glBegin(GL_QUADS);
 				{
-					float OrthAngle = play->GetRadianAngle(play->Angle) - M_PI / 2;
+					float OrthAngle = play->GetRadianAngle(Angle) - M_PI / 2;
 					float CosOrth = cos(OrthAngle);
 					float SinOrth = sin(OrthAngle);
 
 					glTexCoord2f(1, 0);
-					glVertex3f(lvl->things[i]->PosY() + SinOrth * lvl->things[i]->Radius(),
-						lvl->things[i]->PosZ() + lvl->things[i]->Height(),
-						lvl->things[i]->PosX() + CosOrth * lvl->things[i]->Radius());
+					glVertex3f(Pos.y + SinOrth * lvl->things[i]->Radius(),
+						Pos.z + lvl->things[i]->Height(),
+						Pos.x + CosOrth * lvl->things[i]->Radius());
 
 
 					glTexCoord2f(0, 0);
-					glVertex3f(lvl->things[i]->PosY() - SinOrth * lvl->things[i]->Radius(),
-						lvl->things[i]->PosZ() + lvl->things[i]->Height(),
-						lvl->things[i]->PosX() - CosOrth * lvl->things[i]->Radius());
+					glVertex3f(Pos.y - SinOrth * lvl->things[i]->Radius(),
+						Pos.z + lvl->things[i]->Height(),
+						Pos.x - CosOrth * lvl->things[i]->Radius());
 
 					glTexCoord2f(0, 1);
-					glVertex3f(lvl->things[i]->PosY() - SinOrth * lvl->things[i]->Radius(),
-						lvl->things[i]->PosZ(),
-						lvl->things[i]->PosX() - CosOrth * lvl->things[i]->Radius());
+					glVertex3f(Pos.y - SinOrth * lvl->things[i]->Radius(),
+						Pos.z,
+						Pos.x - CosOrth * lvl->things[i]->Radius());
 
 					glTexCoord2f(1, 1);
-					glVertex3f(lvl->things[i]->PosY() + SinOrth * lvl->things[i]->Radius(),
-						lvl->things[i]->PosZ(),
-						lvl->things[i]->PosX() + CosOrth * lvl->things[i]->Radius());
+					glVertex3f(Pos.y + SinOrth * lvl->things[i]->Radius(),
+						Pos.z,
+						Pos.x + CosOrth * lvl->things[i]->Radius());
 				}
 				glEnd();
 			}
@@ -556,6 +520,8 @@ void DrawScreen(GLFWwindow* window, Player* play, Level* lvl, unsigned int Frame
 	{
 		RenderText(lvl, view.message, -0.9f, 0.3f, 0.05f, 0.15f);	// Message
 	}
+	if (view.status.size() > 0)
+		RenderText(lvl, view.status, -0.9f, 0.0f, 0.05f, 0.15f);	// Status
 
 	DrawCursor(lvl);
 
@@ -576,6 +542,12 @@ void ShowMessage(GameWindow& view, const string& message, const int time)
 
 void Close_OpenGL(GLFWwindow* window)
 {
+	Cache::Instance()->Release(fontfile);
+	Cache::Instance()->Release(crosshair);
+
+	// Delete the textures while the OpenGL context still exists
+	Cache::DestroyInstance();
+
 	glfwDestroyWindow(window);
 	glfwTerminate();
 }
@@ -33,6 +33,7 @@ using namespace std;
 const string WindowIcon = "planet.png";
 const string chars = "!\"#$%&'()*+,-./0123456789:;<=>?@ABCDEFGHIJKLMNOPQRSTUVWXYZ[\\]^_`abcdefghijklmnopqrstuvwxyz{|}~";
 const string fontfile = "chars.png";
+const string crosshair = "crosshair.png";
 
 /****************************** Window ******************************/
 
@@ -55,6 +56,7 @@ struct GameWindow
 	string message;
 	unsigned int timer = 0;
 	static const unsigned int MESSAGE_TIME = 5 * 1000;	// ms
+	string status;	// Stays on screen until it's cleared, like while waiting for the other players
 
 	// Array for keypresses. The first 31 items are never changed because they have no corresponding key. This wastes a bit of memory.
 	// Use the key handling functions to manipulate.
@@ -71,11 +73,13 @@ bool KeyPressed(int key);
 
 void SetWindowTitle(GLFWwindow* window, string Title);
 
-GLFWwindow* Init_OpenGL(const bool fullscreen, const string& windowTitle);
+// With 'vsync', the framerate is limited to the screen's refresh rate
+GLFWwindow* Init_OpenGL(const bool fullscreen, const string& windowTitle, const bool vsync = false);
 
 void InitProjection(GLFWwindow* window);
 
-void DrawScreen(GLFWwindow* window, Player* play, Level* lvl, unsigned int FrameDelay);
+// 'Alpha' is the time since the last tic, as a fraction of a tic. The things are drawn between their last two positions.
+void DrawScreen(GLFWwindow* window, Player* play, Level* lvl, unsigned int FrameDelay, float Alpha = 1.0f);
 
 void Close_OpenGL(GLFWwindow* window);
 
@@ -0,0 +1,100 @@
+// Copyright (C) 2020 Alexandre-Xavier Labonté-Lamoureux
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// world.cpp
+// A game that can run next to other games in the same process. It owns its level, its random numbers and its tic.
+
+#include "world.h"
+#include "random.h"		/* GetIndex, SetIndex */
+
+using namespace std;
+
+// Gives the random numbers of a world to the thread, and takes them back at the end of the scope
+class RandomScope
+{
+private:
+	unsigned short& index_;
+	unsigned short saved_;	// Numbers of the thread
+
+public:
+	explicit RandomScope(unsigned short& index): index_(index), saved_(GetIndex())
+	{
+		SetIndex(index_);
+	}
+
+	~RandomScope()
+	{
+		index_ = GetIndex();
+		SetIndex(saved_);
+	}
+};
+
+World::World(const string& level, float scaling, unsigned int players, unsigned short seed, bool optimize)
+{
+	randIndex_ = seed;
+
+	// The spawn spots are random
+	RandomScope random(randIndex_);
+	level_ = new Level(level, scaling, players, optimize);
+	level_->play = level_->players[0];
+}
+
+World::~World()
+{
+	delete level_;
+}
+
+void World::Tick(const Ticcmd* cmds)
+{
+	RandomScope random(randIndex_);
+
+	for (unsigned int i = 0; i < level_->players.size(); i++)
+	{
+		level_->players[i]->Cmd = cmds[i];
+	}
+
+	level_->RunTic();
+	tic_++;
+}
+
+unsigned int World::Tic() const
+{
+	return tic_;
+}
+
+unsigned int World::Checksum() const
+{
+	unsigned short index = randIndex_;
+	RandomScope random(index);
+	return level_->Checksum();
+}
+
+void World::Save(vector<unsigned char>& world) const
+{
+	unsigned short index = randIndex_;
+	RandomScope random(index);
+	level_->SaveWorld(world, tic_);
+}
+
+void World::Load(const unsigned char* world, size_t size)
+{
+	RandomScope random(randIndex_);
+	tic_ = level_->LoadWorld(world, size);
+}
+
+const Level& World::GetLevel() const
+{
+	return *level_;
+}
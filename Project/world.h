@@ -0,0 +1,57 @@
+// Copyright (C) 2020 Alexandre-Xavier Labonté-Lamoureux
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// world.h
+// A game that can run next to other games in the same process. It owns its level, its random numbers and its tic.
+
+#ifndef WORLD_H
+#define WORLD_H
+
+#include "level.h"
+#include "ticcmd.h"
+
+#include <cstddef>	/* size_t */
+#include <string>
+#include <vector>
+using namespace std;
+
+class World
+{
+private:
+	Level* level_ = nullptr;
+	unsigned short randIndex_ = 0;	// Given to the thread while the world runs
+	unsigned int tic_ = 0;	// Next tic
+
+public:
+	World(const string& level, float scaling, unsigned int players, unsigned short seed, bool optimize = true);
+	World(const World&) = delete;
+	World& operator=(const World&) = delete;
+	~World();
+
+	// Runs the next tic with a command for each player. The random numbers of the calling thread are left as they were,
+	// so any number of worlds can be stepped by any thread, as long as a world is used by one thread at a time.
+	void Tick(const Ticcmd* cmds);
+
+	unsigned int Tic() const;
+	unsigned int Checksum() const;
+
+	// Snapshot of the state and the tic (see Level::SaveWorld)
+	void Save(vector<unsigned char>& world) const;
+	void Load(const unsigned char* world, size_t size);
+
+	const Level& GetLevel() const;
+};
+
+#endif	// WORLD_H
@@ -12,9 +12,9 @@ if [ "$#" -ge 1 ] && [ "$1" == "release" ]; then
 	echo "Building release"
 	shift
 	echo "$EXENAME args: $@"
-	g++ *.cpp -std=c++14 -O2 -s -Wall -Wextra -lglfw -lGL -lGLU -lSDL2 -lSDL2_image -lzmq -o $EXENAME && ./$EXENAME $@
+	g++ *.cpp -std=c++14 -O2 -s -Wall -Wextra -pthread -lglfw -lGL -lGLU -lSDL2 -lSDL2_image -lzmq -lrt -o $EXENAME && ./$EXENAME $@
 else
 	echo "Building default"
 	echo "$EXENAME args: $@"
-	g++ *.cpp -std=c++14 -g -Wall -Wextra -lglfw -lGL -lGLU -lSDL2 -lSDL2_image -lzmq -o $EXENAME && ./$EXENAME $@
+	g++ *.cpp -std=c++14 -g -Wall -Wextra -pthread -lglfw -lGL -lGLU -lSDL2 -lSDL2_image -lzmq -lrt -o $EXENAME && ./$EXENAME $@
 fi